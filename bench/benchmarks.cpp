@@ -0,0 +1,416 @@
+//Project name : Smart Home Automation
+//file name : benchmarks.cpp
+
+#include <atomic>
+#include <cstdio>
+#include <condition_variable>
+#include <cstdint>
+#include <ctime>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "commands.h"
+#include "energy_kernel.h"
+#include "home.h"
+#include "scheduler.h"
+#include "simulation.h"
+#include "usage_report.h"
+
+namespace {
+
+const std::time_t BASE_TIME = 1700000000;
+const size_t DEVICES_PER_ROOM = 100;
+
+// Home with 'devices' devices spread over rooms of DEVICES_PER_ROOM, each
+// holding 'recordsPerDevice' closed one-minute records. Nothing is persisted
+// because the journal is never opened.
+void buildHome(Home& home, size_t devices, size_t recordsPerDevice) {
+    for (size_t id = 0; id < devices; ++id) {
+        if (id % DEVICES_PER_ROOM == 0) {
+            home.addRoom("Room " + std::to_string(id / DEVICES_PER_ROOM));
+        }
+        size_t roomIndex = home.rooms.size() - 1;
+        home.addDevice(roomIndex, "Device " + std::to_string(id), 10.0 + double(id % 50));
+        for (size_t r = 0; r < recordsPerDevice; ++r) {
+            ActivationRecord record;
+            record.onTime = BASE_TIME + std::time_t(r) * 3600;
+            record.offTime = record.onTime + 60;
+            home.registry.addClosedRecord(id, record);
+        }
+    }
+}
+
+void BM_CalculateEnergyConsumed(benchmark::State& state) {
+    Home home;
+    buildHome(home, 1, 0);
+    for (int64_t r = 0; r < state.range(0); ++r) {
+        ActivationRecord record;
+        record.onTime = BASE_TIME + r * 120;
+        record.offTime = record.onTime + 60;
+        home.registry.addClosedRecord(0, record);
+    }
+    home.registry.openRecord(0, BASE_TIME + state.range(0) * 120);
+    const Device& device = home.rooms[0].devices[0];
+    std::time_t now = BASE_TIME + state.range(0) * 120 + 30;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(device.calculateEnergyConsumed(now));
+    }
+    state.counters["records"] = double(home.registry.recordsInMemory());
+}
+BENCHMARK(BM_CalculateEnergyConsumed)->RangeMultiplier(10)->Range(100, 1000000);
+
+// The aggregation pass behind the Reports and Trends screens
+void BM_AggregateUsage(benchmark::State& state) {
+    Home home;
+    buildHome(home, size_t(state.range(0)), 2);
+    std::time_t now = BASE_TIME + 3 * 3600;
+    for (auto _ : state) {
+        UsageSummary summary = aggregateUsage(home, now, 3);
+        benchmark::DoNotOptimize(summary.totalEnergy);
+    }
+    state.SetItemsProcessed(int64_t(state.iterations()) * state.range(0));
+}
+BENCHMARK(BM_AggregateUsage)->RangeMultiplier(10)->Range(100, 1000000)->Unit(benchmark::kMicrosecond);
+
+// The same pass spread over a report pool; the second argument is the
+// number of threads taking part, including the caller
+void BM_AggregateUsageParallel(benchmark::State& state) {
+    Home home;
+    buildHome(home, size_t(state.range(0)), 2);
+    ThreadPool pool(size_t(state.range(1)) - 1);
+    home.reportPool = &pool;
+    std::time_t now = BASE_TIME + 3 * 3600;
+    for (auto _ : state) {
+        UsageSummary summary = aggregateUsage(home, now, 3);
+        benchmark::DoNotOptimize(summary.totalEnergy);
+    }
+    home.reportPool = nullptr;
+    state.SetItemsProcessed(int64_t(state.iterations()) * state.range(0));
+}
+BENCHMARK(BM_AggregateUsageParallel)->ArgsProduct({ { 100000, 1000000 }, { 2, 4, 8 } })
+    ->Unit(benchmark::kMicrosecond)->UseRealTime();
+
+// The top 3 rooms and devices of each ranking served from the trend index,
+// with one device in a hundred ON
+void BM_QueryTrends(benchmark::State& state) {
+    Home home;
+    size_t devices = size_t(state.range(0));
+    buildHome(home, devices, 2);
+    home.trends.rebuild(home.registry, home.rooms.size());
+    for (size_t id = 0; id < devices; id += 100) {
+        switchDevice(home, id, true, BASE_TIME + 2 * 3600);
+    }
+    std::time_t now = BASE_TIME + 3 * 3600;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(home.trends.topEnergyRooms(home.registry, now, 3).data());
+        benchmark::DoNotOptimize(home.trends.topEnergyDevices(home.registry, now, 3).data());
+        benchmark::DoNotOptimize(home.trends.topActiveDevices(home.registry, now, 3).data());
+    }
+}
+BENCHMARK(BM_QueryTrends)->RangeMultiplier(10)->Range(100, 1000000)->Unit(benchmark::kMicrosecond);
+
+// Formatting the status of every device, as the Device Status screen and
+// the status command do, into a buffer reused from one dump to the next
+void BM_WriteStatus(benchmark::State& state) {
+    Home home;
+    size_t devices = size_t(state.range(0));
+    buildHome(home, devices, 0);
+    ReportFormat format = ReportFormat(state.range(1));
+    std::string out;
+    for (auto _ : state) {
+        out.clear();
+        writeStatus(home, format, out);
+        benchmark::DoNotOptimize(out.data());
+    }
+    state.SetItemsProcessed(int64_t(state.iterations()) * state.range(0));
+    state.SetBytesProcessed(int64_t(state.iterations()) * int64_t(out.size()));
+}
+BENCHMARK(BM_WriteStatus)->ArgsProduct({ { 1000, 100000 }, { FORMAT_TEXT, FORMAT_JSON, FORMAT_CSV } })
+    ->Unit(benchmark::kMicrosecond);
+
+// Pricing every record under a time-of-use tariff with monthly tiers;
+// the argument is the number of records, spread over 1000 devices
+void BM_ComputeCosts(benchmark::State& state) {
+    Home home;
+    buildHome(home, 1000, size_t(state.range(0)) / 1000);
+    std::istringstream tariff("rate 0.009\n"
+                              "window peak 17:00 21:00 weekdays 0.02\n"
+                              "window night 23:00 06:00 daily 0.004\n"
+                              "tier 500 0.001\n");
+    std::string error;
+    parseTariff(tariff, home.tariff, error);
+    UsageSummary summary = aggregateUsage(home, BASE_TIME + state.range(0) * 4, 0);
+    for (auto _ : state) {
+        UsageCost cost = computeCosts(home, summary);
+        benchmark::DoNotOptimize(cost.total);
+    }
+    state.SetItemsProcessed(int64_t(state.iterations()) * state.range(0));
+}
+BENCHMARK(BM_ComputeCosts)->RangeMultiplier(10)->Range(1000, 1000000)->Unit(benchmark::kMillisecond);
+
+// Active seconds over the last week of records, as the Trends screen asks;
+// the argument is the number of records in memory, spread over 1000 devices
+void BM_ActiveSecondsInRange(benchmark::State& state) {
+    Home home;
+    size_t recordsPerDevice = size_t(state.range(0)) / 1000;
+    buildHome(home, 1000, recordsPerDevice);
+    std::time_t now = BASE_TIME + std::time_t(recordsPerDevice) * 3600;
+    for (auto _ : state) {
+        std::vector<double> seconds = activeSecondsInRange(home, now - 7 * 24 * 3600, now, now);
+        benchmark::DoNotOptimize(seconds.data());
+    }
+    const RecordArena& arena = home.registry.recordArena();
+    state.counters["bytesPerRecord"] = double(arena.blocksInUse() * sizeof(RecordArena::Block)) /
+                                       double(home.registry.recordsInMemory());
+    state.SetItemsProcessed(int64_t(state.iterations()) * state.range(0));
+}
+BENCHMARK(BM_ActiveSecondsInRange)->RangeMultiplier(10)->Range(1000, 1000000)->Unit(benchmark::kMicrosecond);
+
+// Interval kernels on their own; the second argument picks the kernel
+// (0 scalar, 1 AVX2 where the CPU has it). Returns the kernel to restore.
+EnergyKernel setKernel(benchmark::State& state) {
+    EnergyKernel previous = activeEnergyKernel();
+    state.SetLabel(energyKernelName(forceEnergyKernel(state.range(1) ? KERNEL_AVX2 : KERNEL_SCALAR)));
+    return previous;
+}
+
+void BM_ClippedSeconds(benchmark::State& state) {
+    EnergyKernel previous = setKernel(state);
+    std::vector<ActivationRecord> records(size_t(state.range(0)));
+    for (size_t r = 0; r < records.size(); ++r) {
+        records[r].onTime = BASE_TIME + std::time_t(r) * 120;
+        records[r].offTime = r + 1 == records.size() ? 0 : records[r].onTime + 60;
+    }
+    std::time_t from = BASE_TIME + std::time_t(records.size()) * 30;
+    std::time_t now = BASE_TIME + std::time_t(records.size()) * 120;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(clippedSeconds(records.data(), records.size(), from, now, now));
+    }
+    state.SetBytesProcessed(int64_t(state.iterations()) * state.range(0) * int64_t(sizeof(ActivationRecord)));
+    forceEnergyKernel(previous);
+}
+BENCHMARK(BM_ClippedSeconds)->ArgsProduct({ benchmark::CreateRange(100, 1000000, 10), { 0, 1 } })->Unit(benchmark::kMicrosecond);
+
+void BM_DeviceTotals(benchmark::State& state) {
+    EnergyKernel previous = setKernel(state);
+    Home home;
+    buildHome(home, size_t(state.range(0)), 1);
+    for (size_t id = 0; id < home.registry.size(); id += 2) {
+        home.registry.openRecord(id, BASE_TIME + 7200);
+    }
+    std::vector<double> activeSeconds(home.registry.size());
+    std::vector<double> energy(home.registry.size());
+    for (auto _ : state) {
+        deviceTotals(home.registry.closedActiveSeconds.data(), home.registry.openOnTimes.data(),
+                     home.registry.powerRatings.data(), home.registry.size(), BASE_TIME + 9000,
+                     activeSeconds.data(), energy.data());
+        benchmark::DoNotOptimize(energy.data());
+    }
+    state.SetItemsProcessed(int64_t(state.iterations()) * state.range(0));
+    forceEnergyKernel(previous);
+}
+BENCHMARK(BM_DeviceTotals)->ArgsProduct({ benchmark::CreateRange(100, 1000000, 10), { 0, 1 } })->Unit(benchmark::kMicrosecond);
+
+// ON/OFF transitions spread over all devices, one second apart
+void BM_Toggle(benchmark::State& state) {
+    Home home;
+    size_t devices = size_t(state.range(0));
+    buildHome(home, devices, 0);
+    std::mt19937 random(42);
+    std::uniform_int_distribution<size_t> pick(0, devices - 1);
+    std::time_t at = BASE_TIME;
+    for (auto _ : state) {
+        size_t id = pick(random);
+        std::lock_guard<std::mutex> lock(home.mutex);
+        switchDevice(home, id, !home.registry.status(id), ++at);
+        // Stand-in for the history flush, which needs an open journal
+        if (home.registry.recordsInMemory() >= HISTORY_FLUSH_RECORDS) {
+            home.registry.dropClosedRecords();
+        }
+    }
+    state.SetItemsProcessed(int64_t(state.iterations()));
+}
+BENCHMARK(BM_Toggle)->RangeMultiplier(10)->Range(100, 1000000);
+
+// A day of a synthetic household on a virtual clock, ten uses per device,
+// including building the household; items are the switches applied
+void BM_Simulate(benchmark::State& state) {
+    SimulationPlan plan;
+    plan.rooms = size_t(state.range(0)) / DEVICES_PER_ROOM;
+    plan.devicesPerRoom = DEVICES_PER_ROOM;
+    plan.togglesPerDay = 10.0;
+    plan.days = 1.0;
+    plan.seed = 42;
+    size_t switches = 0;
+    for (auto _ : state) {
+        VirtualClock clock(BASE_TIME);
+        Home home;
+        useVirtualClock(home, clock);
+        SimulationResult result;
+        std::string error;
+        simulateHousehold(home, plan, result, error);
+        switches += result.switches;
+    }
+    state.SetItemsProcessed(int64_t(switches));
+}
+BENCHMARK(BM_Simulate)->RangeMultiplier(10)->Range(100, 10000)->Unit(benchmark::kMillisecond);
+
+// Admit 'n' one-hour daily schedules of 1 kW each under a 200 kW cap,
+// delaying those that do not fit; nothing is armed or journaled
+void BM_FitSchedule(benchmark::State& state) {
+    size_t count = size_t(state.range(0));
+    Home home;
+    buildHome(home, 1, 0);
+    home.registry.powerRatings[0] = 1000.0;
+    home.tariff.powerCap = 200000.0;
+    std::mt19937 random(42);
+    std::uniform_int_distribution<int> minute(0, 24 * 60 - 1);
+    size_t admitted = 0;
+    for (auto _ : state) {
+        state.PauseTiming();
+        home.scheduledLoad.clear();
+        state.ResumeTiming();
+        admitted = 0;
+        for (size_t i = 0; i < count; ++i) {
+            ScheduleRule rule = ScheduleRule();
+            rule.deviceId = 0;
+            rule.onMinute = minute(random);
+            rule.durationMinutes = 60;
+            rule.dayMask = EVERY_DAY;
+            rule.repeat = true;
+            if (fitSchedule(home, rule, LOAD_DELAY)) {
+                for (int day = 0; day < 7; ++day) {
+                    home.scheduledLoad.add(day * 24 * 60 + rule.onMinute, rule.durationMinutes, 1000000);
+                }
+                ++admitted;
+            }
+        }
+    }
+    state.counters["admitted"] = double(admitted);
+    state.SetItemsProcessed(int64_t(state.iterations()) * state.range(0));
+}
+BENCHMARK(BM_FitSchedule)->RangeMultiplier(10)->Range(100, 10000)->Unit(benchmark::kMillisecond);
+
+// Record 'n' one-second power samples spread over 100 metered devices into a
+// sample file, flushing what is still buffered at the end
+void BM_RecordSamples(benchmark::State& state) {
+    const char* const path = "bench_samples.telemetry";
+    size_t count = size_t(state.range(0));
+    Home home;
+    buildHome(home, 100, 0);
+    std::remove(path);
+    home.telemetry.open(path);
+    std::int64_t time = BASE_TIME;
+    for (auto _ : state) {
+        for (size_t i = 0; i < count; ++i) {
+            time += i % 100 == 0 ? 1 : 0;
+            home.telemetry.record(i % 100, time, 50.0 + double(i % 7));
+        }
+        home.telemetry.flush();
+    }
+    home.telemetry.close();
+    std::remove(path);
+    state.SetItemsProcessed(int64_t(state.iterations()) * state.range(0));
+}
+BENCHMARK(BM_RecordSamples)->RangeMultiplier(10)->Range(1000, 1000000)->Unit(benchmark::kMicrosecond);
+
+// Replay a recorded trace of 'n' samples over 100 meters: parsing, name
+// resolution and recording, as the ingest command does
+void BM_IngestTrace(benchmark::State& state) {
+    const char* const tracePath = "bench_trace.txt";
+    const char* const samplePath = "bench_trace.telemetry";
+    size_t count = size_t(state.range(0));
+    std::FILE* trace = std::fopen(tracePath, "wb");
+    for (size_t id = 0; id < 100; ++id) {
+        std::fprintf(trace, "meter %zu Meters M%zu\n", id, id);
+    }
+    for (size_t i = 0; i < count; ++i) {
+        std::fprintf(trace, "%lld %zu %.2f\n", static_cast<long long>(BASE_TIME + std::time_t(i / 100)), i % 100,
+                     50.0 + double(i % 7) / 4.0);
+    }
+    std::fclose(trace);
+    std::string command = std::string("ingest ") + tracePath;
+    for (auto _ : state) {
+        state.PauseTiming();
+        std::string out, error;
+        bool quit = false;
+        {
+            Home home;
+            home.addRoom("Meters");
+            for (size_t id = 0; id < 100; ++id) {
+                home.addDevice(0, "M" + std::to_string(id), 50.0);
+            }
+            std::remove(samplePath);
+            home.telemetry.open(samplePath);
+            state.ResumeTiming();
+            executeCommand(home, command, ORIGIN_LOCAL, out, error, quit);
+            state.PauseTiming();
+        }
+        state.ResumeTiming();
+    }
+    std::remove(tracePath);
+    std::remove(samplePath);
+    state.SetItemsProcessed(int64_t(state.iterations()) * state.range(0));
+}
+BENCHMARK(BM_IngestTrace)->RangeMultiplier(10)->Range(10000, 1000000)->Unit(benchmark::kMillisecond);
+
+// Queue 'n' timers with random deadlines, then pop them all in order
+void BM_TimerQueuePushPop(benchmark::State& state) {
+    size_t count = size_t(state.range(0));
+    std::mt19937 random(42);
+    std::uniform_int_distribution<std::time_t> due(BASE_TIME, BASE_TIME + 7 * 24 * 3600);
+    for (auto _ : state) {
+        TimerQueue queue;
+        TimerEvent event;
+        event.deviceId = 0;
+        event.turnOn = true;
+        event.ruleId = 0;
+        for (size_t i = 0; i < count; ++i) {
+            event.due = due(random);
+            event.sequence = i;
+            queue.push(event);
+        }
+        while (!queue.empty()) {
+            benchmark::DoNotOptimize(queue.pop().due);
+        }
+    }
+    state.SetItemsProcessed(int64_t(state.iterations()) * state.range(0));
+}
+BENCHMARK(BM_TimerQueuePushPop)->RangeMultiplier(10)->Range(100, 1000000)->Unit(benchmark::kMicrosecond);
+
+// Schedule 'n' transitions that are already due and wait until the
+// scheduler thread has fired all of them
+void BM_SchedulerInsertFire(benchmark::State& state) {
+    size_t count = size_t(state.range(0));
+    for (auto _ : state) {
+        std::mutex mutex;
+        std::condition_variable done;
+        size_t fired = 0;
+        Scheduler scheduler([&](const TimerEvent&) {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (++fired == count) {
+                done.notify_one();
+            }
+        });
+        for (size_t i = 0; i < count; ++i) {
+            scheduler.schedule(i % 1000, BASE_TIME + std::time_t(i % 60), i % 2 == 0, 0);
+        }
+        std::unique_lock<std::mutex> lock(mutex);
+        while (fired < count) {
+            done.wait(lock);
+        }
+        lock.unlock();
+        scheduler.stop();
+    }
+    state.SetItemsProcessed(int64_t(state.iterations()) * state.range(0));
+}
+BENCHMARK(BM_SchedulerInsertFire)->RangeMultiplier(10)->Range(100, 1000000)->Unit(benchmark::kMicrosecond)->UseRealTime();
+
+} // namespace
+
+BENCHMARK_MAIN();
@@ -6,81 +6,25 @@
 
 
 #include <iostream>
-#include <vector>
 #include <string>
 #include <ctime>
 #include <chrono>
 #include <iomanip>
+#include <sstream>
 #include <algorithm>
-#include <map>
-#include <thread>
-#include <sstream>   
+#include <fstream>
+#include <cstring>
 #include <climits>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <thread>
 
-// Utility function to get current date and time as a string
-std::string currentDateTime() {
-    auto now = std::chrono::system_clock::now();
-    std::time_t now_c = std::chrono::system_clock::to_time_t(now);
-    std::tm *tm_local = std::localtime(&now_c);
-    char buffer[100];
-    std::strftime(buffer, sizeof(buffer), "%c", tm_local);
-    return std::string(buffer);
-}
-
-// Activation record for devices
-struct ActivationRecord {
-    std::time_t onTime;
-    std::time_t offTime;
-};
-
-// Device class
-class Device {
-public:
-    std::string name;
-    double powerRating; 
-    bool status; 
-    std::vector<ActivationRecord> activationRecords;
-
-    Device(std::string n, double p) : name(n), powerRating(p), status(false) {}
-
-    // Calculate energy consumed by this device
-    double calculateEnergyConsumed() const {
-        double totalEnergy = 0.0;
-        for (const auto& record : activationRecords) {
-            std::time_t endTime = record.offTime;
-            if (record.offTime == 0) {
-                // Device is still ON, use current time
-                endTime = std::time(nullptr);
-            }
-            double duration = difftime(endTime, record.onTime) / 3600.0; 
-            totalEnergy += (powerRating / 1000.0) * duration;
-        }
-        return totalEnergy;
-    }
-
-    // Calculate total activation time
-    double totalActiveTime() const {
-        double totalTime = 0.0;
-        for (const auto& record : activationRecords) {
-            std::time_t endTime = record.offTime;
-            if (record.offTime == 0) {
-                // Device is still ON, use current time
-                endTime = std::time(nullptr);
-            }
-            totalTime += difftime(endTime, record.onTime);
-        }
-        return totalTime; // in seconds
-    }
-};
-
-// Room class
-class Room {
-public:
-    std::string name;
-    std::vector<Device> devices;
-
-    Room(std::string n) : name(n) {}
-};
+#include "commands.h"
+#include "control_server.h"
+#include "home.h"
+#include "time_util.h"
+#include "usage_report.h"
 
 // Authentication function
 bool authenticateUser() {
@@ -106,96 +50,228 @@ bool authenticateUser() {
     return false;
 }
 
-// Function prototypes
-void mainMenu(std::vector<Room>& rooms);
-void settingsMenu(std::vector<Room>& rooms);
-void initializeMenu(std::vector<Room>& rooms);
-void addRooms(std::vector<Room>& rooms);
-void addDevices(std::vector<Room>& rooms);
-void modeSelectionMenu(std::vector<Room>& rooms);
-void manualMode(std::vector<Room>& rooms);
-void timerMode(std::vector<Room>& rooms);
-void enquireDeviceStatus(const std::vector<Room>& rooms);
-void displayReports(const std::vector<Room>& rooms);
-void displayTrends(const std::vector<Room>& rooms);
-void updateFeatures(std::vector<Room>& rooms);
+void mainMenu(Home& home);
+void settingsMenu(Home& home);
+void initializeMenu(Home& home);
+void addRooms(Home& home);
+void addDevices(Home& home);
+void modeSelectionMenu(Home& home);
+void manualMode(Home& home);
+void timerMode(Home& home);
+void enquireDeviceStatus(const Home& home);
+void displayReports(const Home& home);
+void displayTrends(const Home& home);
+void displayUsageHistory(const Home& home);
+void updateFeatures(Home& home);
+
+// Thrown when standard input ends while a menu is waiting for an answer
+struct InputClosed {};
+
+// Clear a failed read before asking again; gives up once input has ended
+void recoverInput() {
+    if (std::cin.eof()) {
+        throw InputClosed();
+    }
+    std::cin.clear();
+}
+
+// Every screen is formatted into this buffer and written out with one call;
+// it keeps its capacity from one screen to the next
+std::string screen;
+
+// Start a screen with the banner and its title
+void beginScreen(const char* title, const std::string& detail = std::string()) {
+    screen += "####################################################\n"
+              " Welcome to mySmart Home\n";
+    screen += title;
+    screen += detail;
+    screen += '\n';
+}
+
+// Close the screen with the home's date and time, then write it and
+// 'prompt' out
+void endScreen(const Home& home, const char* prompt = "") {
+    appendDateTime(screen, home.now());
+    screen += "\n####################################################\n";
+    screen += prompt;
+    writeOut(screen);
+}
+
+// Numbers on screens keep the six significant digits of std::cout
+const int SCREEN_DIGITS = 6;
 
 // Main function
-int main() {
-    std::vector<Room> rooms;
-    mainMenu(rooms);
+int main(int argc, char* argv[]) {
+    std::string batchFile;
+    std::string serveAddress;
+    size_t workers = std::max(1u, std::thread::hardware_concurrency());
+    size_t reportThreads = workers;
+    bool batch = false;
+    long long clockStart = 0;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--batch") {
+            batch = true;
+            if (i + 1 < argc && (argv[i + 1][0] != '-' || std::strcmp(argv[i + 1], "-") == 0)) {
+                batchFile = argv[++i];
+            }
+        } else if (arg == "--serve" && i + 1 < argc) {
+            serveAddress = argv[++i];
+        } else if (arg == "--workers" && i + 1 < argc && std::atoi(argv[i + 1]) > 0) {
+            workers = static_cast<size_t>(std::atoi(argv[++i]));
+        } else if (arg == "--report-threads" && i + 1 < argc && std::atoi(argv[i + 1]) > 0) {
+            reportThreads = static_cast<size_t>(std::atoi(argv[++i]));
+        } else if (arg == "--clock" && i + 1 < argc && std::atoll(argv[i + 1]) > 0) {
+            clockStart = std::atoll(argv[++i]);
+        } else {
+            std::cerr << "Usage: " << argv[0] << " [--batch [file|-] [--clock <unix time>]]"
+                << " [--serve <port>|unix:<path> [--workers <n>]] [--report-threads <n>]\n";
+            return 2;
+        }
+    }
+    if (clockStart > 0 && !batch) {
+        std::cerr << "--clock only applies to --batch\n";
+        return 2;
+    }
+
+    // A batch run on a virtual clock starts from an empty home that is never
+    // saved, and sees only the times its commands set, so the same input
+    // always gives the same output
+    bool simulated = clockStart > 0;
+    VirtualClock virtualClock(static_cast<std::time_t>(clockStart));
+    Home home;
+    if (simulated) {
+        useVirtualClock(home, virtualClock);
+    }
+    // Reports use the calling thread plus reportThreads - 1 helpers
+    std::unique_ptr<ThreadPool> reportPool;
+    if (reportThreads > 1) {
+        reportPool.reset(new ThreadPool(reportThreads - 1));
+        home.reportPool = reportPool.get();
+    }
+    auto started = std::chrono::steady_clock::now();
+    size_t replayed = 0;
+    if (!simulated && !restoreHome(home, home.now(), replayed)) {
+        std::cout << "Saved state in " << SNAPSHOT_PATH << " is corrupt. "
+            << "Move it away to start with an empty home.\n";
+        return 1;
+    }
+    std::ifstream tariffFile(TARIFF_PATH);
+    std::string tariffError;
+    if (tariffFile && !parseTariff(tariffFile, home.tariff, tariffError)) {
+        std::cout << "Tariff in " << TARIFF_PATH << " is invalid: " << tariffError << "\n";
+        return 1;
+    }
+    if (batch) {
+        std::ios::sync_with_stdio(false);
+        size_t failures;
+        if (batchFile.empty() || batchFile == "-") {
+            failures = runBatch(home, std::cin);
+        } else {
+            std::ifstream file(batchFile);
+            if (!file) {
+                std::cerr << "Cannot open " << batchFile << "\n";
+                return 1;
+            }
+            failures = runBatch(home, file);
+        }
+        home.scheduler.stop();
+        if (!simulated) {
+            std::lock_guard<std::mutex> lock(home.mutex);
+            writeSnapshot(home);
+        }
+        return failures == 0 ? 0 : 1;
+    }
+    if (!serveAddress.empty()) {
+        bool served = runServer(home, serveAddress, workers);
+        home.scheduler.stop();
+        std::lock_guard<std::mutex> lock(home.mutex);
+        writeSnapshot(home);
+        return served ? 0 : 1;
+    }
+    if (!home.rooms.empty()) {
+        auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - started);
+        std::cout << "Restored " << home.rooms.size() << " rooms and " << home.registry.size()
+            << " devices (" << replayed << " journal entries replayed) in " << elapsed.count() << " ms.\n";
+    }
+    try {
+        mainMenu(home);
+    } catch (const InputClosed&) {
+        std::cout << "\nInput closed. Exiting the program.\n";
+    }
+
+    // Stop timers before the final snapshot so no transition races with it
+    home.scheduler.stop();
+    std::lock_guard<std::mutex> lock(home.mutex);
+    writeSnapshot(home);
     return 0;
 }
 
 // Main Menu function
-void mainMenu(std::vector<Room>& rooms) {
+void mainMenu(Home& home) {
     int choice;
     do {
         // Display menu options
-        std::cout << "####################################################\n";
-        std::cout << " Welcome to mySmart Home\n";
-        std::cout << "Main Menu\n";
-        std::cout << "Press\n";
-        std::cout << "1. Settings\n";
-        std::cout << "2. Enquire device status\n";
-        std::cout << "3. Reports\n";
-        std::cout << "4. Trends\n";
-        std::cout << "5. Exit\n";
-        std::cout << currentDateTime();
-        std::cout << "\n####################################################\n";
-        std::cout << "Enter your choice: ";
+        beginScreen("Main Menu");
+        screen += "Press\n"
+                  "1. Settings\n"
+                  "2. Enquire device status\n"
+                  "3. Reports\n"
+                  "4. Trends\n"
+                  "5. Usage history\n"
+                  "6. Exit\n";
+        endScreen(home, "Enter your choice: ");
         std::cin >> choice;
 
         while (std::cin.fail()) {
-            std::cin.clear(); 
+            recoverInput();
             std::cin.ignore(INT_MAX, '\n'); 
-            std::cout << "Invalid input. Please enter a number between 1 and 5: ";
+            std::cout << "Invalid input. Please enter a number between 1 and 6: ";
             std::cin >> choice;
         }
 
         switch (choice) {
             case 1:
                 if (authenticateUser()) {
-                    settingsMenu(rooms);
+                    settingsMenu(home);
                 }
                 break;
             case 2:
-                enquireDeviceStatus(rooms);
+                enquireDeviceStatus(home);
                 break;
             case 3:
-                displayReports(rooms);
+                displayReports(home);
                 break;
             case 4:
-                displayTrends(rooms);
+                displayTrends(home);
                 break;
             case 5:
+                displayUsageHistory(home);
+                break;
+            case 6:
                 std::cout << "Exiting the program.\n";
                 break;
             default:
-                std::cout << "Invalid choice. Please enter a number between 1 and 5.\n";
+                std::cout << "Invalid choice. Please enter a number between 1 and 6.\n";
         }
-    } while (choice != 5);
+    } while (choice != 6);
 }
 
 // Settings Menu function
-void settingsMenu(std::vector<Room>& rooms) {
+void settingsMenu(Home& home) {
     int choice;
     do {
-        std::cout << "####################################################\n";
-        std::cout << " Welcome to mySmart Home\n";
-        std::cout << "Settings Menu\n";
-        std::cout << "Press\n";
-        std::cout << "1. Initialize the system\n";
-        std::cout << "2. Update the features\n";
-        std::cout << "3. Select modes\n";
-        std::cout << "4. Exit\n";
-        std::cout << currentDateTime();
-        std::cout << "\n####################################################\n";
-        std::cout << "Enter your choice: ";
+        beginScreen("Settings Menu");
+        screen += "Press\n"
+                  "1. Initialize the system\n"
+                  "2. Update the features\n"
+                  "3. Select modes\n"
+                  "4. Exit\n";
+        endScreen(home, "Enter your choice: ");
         std::cin >> choice;
 
         while (std::cin.fail()) {
-            std::cin.clear();
+            recoverInput();
             std::cin.ignore(INT_MAX, '\n');
             std::cout << "Invalid input. Please enter a number between 1 and 4: ";
             std::cin >> choice;
@@ -203,13 +279,13 @@ void settingsMenu(std::vector<Room>& rooms) {
 
         switch (choice) {
             case 1:
-                initializeMenu(rooms);
+                initializeMenu(home);
                 break;
             case 2:
-                updateFeatures(rooms);
+                updateFeatures(home);
                 break;
             case 3:
-                modeSelectionMenu(rooms);
+                modeSelectionMenu(home);
                 break;
             case 4:
                 std::cout << "Exiting Settings Menu.\n";
@@ -221,23 +297,19 @@ void settingsMenu(std::vector<Room>& rooms) {
 }
 
 // Initialize Menu function
-void initializeMenu(std::vector<Room>& rooms) {
+void initializeMenu(Home& home) {
     int choice;
     do {
-        std::cout << "####################################################\n";
-        std::cout << " Welcome to mySmart Home\n";
-        std::cout << "Initialize Menu\n";
-        std::cout << "Press\n";
-        std::cout << "1. Add number of rooms\n";
-        std::cout << "2. Add device\n";
-        std::cout << "3. Exit\n";
-        std::cout << currentDateTime();
-        std::cout << "\n####################################################\n";
-        std::cout << "Enter your choice: ";
+        beginScreen("Initialize Menu");
+        screen += "Press\n"
+                  "1. Add number of rooms\n"
+                  "2. Add device\n"
+                  "3. Exit\n";
+        endScreen(home, "Enter your choice: ");
         std::cin >> choice;
 
         while (std::cin.fail()) {
-            std::cin.clear();
+            recoverInput();
             std::cin.ignore(INT_MAX, '\n');
             std::cout << "Invalid input. Please enter a number between 1 and 3: ";
             std::cin >> choice;
@@ -245,10 +317,10 @@ void initializeMenu(std::vector<Room>& rooms) {
 
         switch (choice) {
             case 1:
-                addRooms(rooms);
+                addRooms(home);
                 break;
             case 2:
-                addDevices(rooms);
+                addDevices(home);
                 break;
             case 3:
                 std::cout << "Exiting Initialize Menu.\n";
@@ -260,13 +332,13 @@ void initializeMenu(std::vector<Room>& rooms) {
 }
 
 // Function to add rooms
-void addRooms(std::vector<Room>& rooms) {
+void addRooms(Home& home) {
     int numRooms;
     std::cout << "Enter number of rooms: ";
     std::cin >> numRooms;
 
     while (std::cin.fail() || numRooms <= 0) {
-        std::cin.clear();
+        recoverInput();
         std::cin.ignore(INT_MAX, '\n');
         std::cout << "Invalid number of rooms. Please enter a positive integer: ";
         std::cin >> numRooms;
@@ -276,25 +348,42 @@ void addRooms(std::vector<Room>& rooms) {
         std::string roomName;
         std::cout << "Enter name for Room " << (i + 1) << ": ";
         std::cin >> roomName;
-        rooms.emplace_back(roomName);
+        std::unique_lock<std::mutex> lock(home.mutex);
+        while (home.findRoom(roomName) != Home::NO_ROOM) {
+            lock.unlock();
+            std::cout << "Room \"" << roomName << "\" already exists. Please enter another name: ";
+            std::cin >> roomName;
+            if (std::cin.fail()) {
+                recoverInput();
+            }
+            lock.lock();
+        }
+        home.addRoom(roomName);
+        lock.unlock();
         std::cout << "Room \"" << roomName << "\" added.\n";
     }
 }
 
+bool deviceExists(const Home& home, size_t roomIndex, const std::string& name) {
+    std::lock_guard<std::mutex> lock(home.mutex);
+    return home.findDevice(roomIndex, name) != Home::NO_DEVICE;
+}
+
 // Function to add devices to rooms
-void addDevices(std::vector<Room>& rooms) {
-    if (rooms.empty()) {
+void addDevices(Home& home) {
+    if (home.rooms.empty()) {
         std::cout << "No rooms available. Please add rooms first.\n";
         return;
     }
-    for (auto& room : rooms) {
+    for (size_t r = 0; r < home.rooms.size(); ++r) {
+        Room& room = home.rooms[r];
         int numDevices;
         std::cout << "Adding devices to " << room.name << ".\n";
         std::cout << "How many devices in " << room.name << "?: ";
         std::cin >> numDevices;
 
         while (std::cin.fail() || numDevices <= 0) {
-            std::cin.clear();
+            recoverInput();
             std::cin.ignore(INT_MAX, '\n');
             std::cout << "Invalid number of devices. Please enter a positive integer: ";
             std::cin >> numDevices;
@@ -305,44 +394,51 @@ void addDevices(std::vector<Room>& rooms) {
             double powerRating;
             std::cout << "Enter name for Device " << (i + 1) << ": ";
             std::cin >> deviceName;
+            while (deviceExists(home, r, deviceName)) {
+                std::cout << "Device \"" << deviceName << "\" already exists in " << room.name
+                    << ". Please enter another name: ";
+                std::cin >> deviceName;
+                if (std::cin.fail()) {
+                    recoverInput();
+                }
+            }
             std::cout << "Enter power rating (in watts) for " << deviceName << ": ";
             std::cin >> powerRating;
 
             while (std::cin.fail() || powerRating <= 0) {
-                std::cin.clear();
+                recoverInput();
                 std::cin.ignore(INT_MAX, '\n');
                 std::cout << "Invalid power rating. Please enter a positive number: ";
                 std::cin >> powerRating;
             }
 
-            room.devices.emplace_back(deviceName, powerRating);
+            {
+                std::lock_guard<std::mutex> lock(home.mutex);
+                home.addDevice(r, deviceName, powerRating);
+            }
             std::cout << "Device \"" << deviceName << "\" added to " << room.name << ".\n";
         }
     }
 }
 
 // Mode Selection Menu function
-void modeSelectionMenu(std::vector<Room>& rooms) {
-    if (rooms.empty()) {
+void modeSelectionMenu(Home& home) {
+    if (home.rooms.empty()) {
         std::cout << "No rooms and devices available. Please initialize the system first.\n";
         return;
     }
     int choice;
     do {
-        std::cout << "####################################################\n";
-        std::cout << " Welcome to mySmart Home\n";
-        std::cout << "Mode Selection Menu\n";
-        std::cout << "Press\n";
-        std::cout << "1. Manual Mode\n";
-        std::cout << "2. Timer Mode\n";
-        std::cout << "3. Exit\n";
-        std::cout << currentDateTime();
-        std::cout << "\n####################################################\n";
-        std::cout << "Enter your choice: ";
+        beginScreen("Mode Selection Menu");
+        screen += "Press\n"
+                  "1. Manual Mode\n"
+                  "2. Timer Mode\n"
+                  "3. Exit\n";
+        endScreen(home, "Enter your choice: ");
         std::cin >> choice;
 
         while (std::cin.fail()) {
-            std::cin.clear();
+            recoverInput();
             std::cin.ignore(INT_MAX, '\n');
             std::cout << "Invalid input. Please enter a number between 1 and 3: ";
             std::cin >> choice;
@@ -350,10 +446,10 @@ void modeSelectionMenu(std::vector<Room>& rooms) {
 
         switch (choice) {
             case 1:
-                manualMode(rooms);
+                manualMode(home);
                 break;
             case 2:
-                timerMode(rooms);
+                timerMode(home);
                 break;
             case 3:
                 std::cout << "Exiting Mode Selection Menu.\n";
@@ -365,41 +461,44 @@ void modeSelectionMenu(std::vector<Room>& rooms) {
 }
 
 // Manual Mode function
-void manualMode(std::vector<Room>& rooms) {
+void manualMode(Home& home) {
     int roomChoice;
     int deviceChoice;
 
     std::cout << "Manual Mode\n";
     // List rooms
-    for (size_t i = 0; i < rooms.size(); ++i) {
-        std::cout << (i + 1) << ". " << rooms[i].name << "\n";
+    for (size_t i = 0; i < home.rooms.size(); ++i) {
+        std::cout << (i + 1) << ". " << home.rooms[i].name << "\n";
     }
     std::cout << "Select a room: ";
     std::cin >> roomChoice;
 
-    while (std::cin.fail() || roomChoice < 1 || roomChoice > (int)rooms.size()) {
-        std::cin.clear();
+    while (std::cin.fail() || roomChoice < 1 || roomChoice > (int)home.rooms.size()) {
+        recoverInput();
         std::cin.ignore(INT_MAX, '\n');
         std::cout << "Invalid room selection. Please try again: ";
         std::cin >> roomChoice;
     }
 
-    Room& selectedRoom = rooms[roomChoice - 1];
+    Room& selectedRoom = home.rooms[roomChoice - 1];
     if (selectedRoom.devices.empty()) {
         std::cout << "No devices in this room. Please add devices first.\n";
         return;
     }
 
     // List devices in the selected room
-    for (size_t i = 0; i < selectedRoom.devices.size(); ++i) {
-        std::cout << (i + 1) << ". " << selectedRoom.devices[i].name << " ("
-            << (selectedRoom.devices[i].status ? "ON" : "OFF") << ")\n";
+    {
+        std::lock_guard<std::mutex> lock(home.mutex);
+        for (size_t i = 0; i < selectedRoom.devices.size(); ++i) {
+            std::cout << (i + 1) << ". " << selectedRoom.devices[i].name() << " ("
+                << (selectedRoom.devices[i].status() ? "ON" : "OFF") << ")\n";
+        }
     }
     std::cout << "Select a device to toggle its status: ";
     std::cin >> deviceChoice;
 
     while (std::cin.fail() || deviceChoice < 1 || deviceChoice >(int)selectedRoom.devices.size()) {
-        std::cin.clear();
+        recoverInput();
         std::cin.ignore(INT_MAX, '\n');
         std::cout << "Invalid device selection. Please try again: ";
         std::cin >> deviceChoice;
@@ -407,26 +506,17 @@ void manualMode(std::vector<Room>& rooms) {
 
     Device& selectedDevice = selectedRoom.devices[deviceChoice - 1];
     // Toggle device status
-    if (selectedDevice.status) {
-        // Device is ON, turn it OFF
-        selectedDevice.status = false;
-        if (!selectedDevice.activationRecords.empty()) {
-            selectedDevice.activationRecords.back().offTime = std::time(nullptr);
-        }
-        std::cout << selectedDevice.name << " turned OFF.\n";
-    } else {
-        // Device is OFF, turn it ON
-        selectedDevice.status = true;
-        ActivationRecord newRecord;
-        newRecord.onTime = std::time(nullptr);
-        newRecord.offTime = 0; 
-        selectedDevice.activationRecords.push_back(newRecord);
-        std::cout << selectedDevice.name << " turned ON.\n";
+    bool turnOn;
+    {
+        std::lock_guard<std::mutex> lock(home.mutex);
+        turnOn = !selectedDevice.status();
+        switchDevice(home, selectedDevice.id(), turnOn, home.now());
     }
+    std::cout << selectedDevice.name() << (turnOn ? " turned ON.\n" : " turned OFF.\n");
 }
 
 // Timer Mode function
-void timerMode(std::vector<Room>& rooms) {
+void timerMode(Home& home) {
     int roomChoice;
     int deviceChoice;
     std::string onTimeStr, offTimeStr;
@@ -434,20 +524,20 @@ void timerMode(std::vector<Room>& rooms) {
 
     std::cout << "Timer Mode\n";
     // List rooms
-    for (size_t i = 0; i < rooms.size(); ++i) {
-        std::cout << (i + 1) << ". " << rooms[i].name << "\n";
+    for (size_t i = 0; i < home.rooms.size(); ++i) {
+        std::cout << (i + 1) << ". " << home.rooms[i].name << "\n";
     }
     std::cout << "Select a room: ";
     std::cin >> roomChoice;
 
-    while (std::cin.fail() || roomChoice < 1 || roomChoice > (int)rooms.size()) {
-        std::cin.clear();
+    while (std::cin.fail() || roomChoice < 1 || roomChoice > (int)home.rooms.size()) {
+        recoverInput();
         std::cin.ignore(INT_MAX, '\n');
         std::cout << "Invalid room selection. Please try again: ";
         std::cin >> roomChoice;
     }
 
-    Room& selectedRoom = rooms[roomChoice - 1];
+    Room& selectedRoom = home.rooms[roomChoice - 1];
     if (selectedRoom.devices.empty()) {
         std::cout << "No devices in this room. Please add devices first.\n";
         return;
@@ -455,13 +545,13 @@ void timerMode(std::vector<Room>& rooms) {
 
     // List devices in the selected room
     for (size_t i = 0; i < selectedRoom.devices.size(); ++i) {
-        std::cout << (i + 1) << ". " << selectedRoom.devices[i].name << "\n";
+        std::cout << (i + 1) << ". " << selectedRoom.devices[i].name() << "\n";
     }
     std::cout << "Select a device to schedule: ";
     std::cin >> deviceChoice;
 
     while (std::cin.fail() || deviceChoice < 1 || deviceChoice > (int)selectedRoom.devices.size()) {
-        std::cin.clear();
+        recoverInput();
         std::cin.ignore(INT_MAX, '\n');
         std::cout << "Invalid device selection. Please try again: ";
         std::cin >> deviceChoice;
@@ -490,159 +580,382 @@ void timerMode(std::vector<Room>& rooms) {
         return;
     }
 
-    std::time_t now = std::time(nullptr);
-    std::tm* now_tm = std::localtime(&now);
-    tm_on.tm_sec = 0;
-    tm_on.tm_year = now_tm->tm_year;
-    tm_on.tm_mon = now_tm->tm_mon;
-    tm_on.tm_mday = now_tm->tm_mday;
-    tm_off.tm_sec = 0;
-    tm_off.tm_year = now_tm->tm_year;
-    tm_off.tm_mon = now_tm->tm_mon;
-    tm_off.tm_mday = now_tm->tm_mday;
-
-    std::time_t on_time = std::mktime(&tm_on);
-    std::time_t off_time = std::mktime(&tm_off);
-
-    if (difftime(off_time, on_time) <= 0) {
-        std::cout << "OFF time must be after ON time.\n";
+    int onMinute = tm_on.tm_hour * 60 + tm_on.tm_min;
+    int offMinute = tm_off.tm_hour * 60 + tm_off.tm_min;
+    if (offMinute == onMinute) {
+        std::cout << "OFF time must differ from ON time.\n";
         return;
     }
 
-    // Schedule the device
-    ActivationRecord newRecord;
-    newRecord.onTime = on_time;
-    newRecord.offTime = off_time;
-    selectedDevice.activationRecords.push_back(newRecord);
+    // Repeat options
+    int repeatChoice;
+    std::cout << "Repeat:\n";
+    std::cout << "1. Once\n";
+    std::cout << "2. Daily\n";
+    std::cout << "3. Weekdays (Mon-Fri)\n";
+    std::cout << "4. Weekends (Sat-Sun)\n";
+    std::cout << "5. Custom days (cron day-of-week, e.g. mon,wed,fri or 1-5)\n";
+    std::cout << "Enter your choice: ";
+    std::cin >> repeatChoice;
+
+    while (std::cin.fail() || repeatChoice < 1 || repeatChoice > 5) {
+        recoverInput();
+        std::cin.ignore(INT_MAX, '\n');
+        std::cout << "Invalid choice. Please enter a number between 1 and 5: ";
+        std::cin >> repeatChoice;
+    }
 
-    std::cout << "Device \"" << selectedDevice.name << "\" scheduled from "
-        << onTimeStr << " to " << offTimeStr << ".\n";
+    std::time_t now = home.now();
+    ScheduleRule rule;
+    rule.deviceId = selectedDevice.id();
+    rule.onMinute = onMinute;
+    // An OFF time before the ON time runs overnight into the next day
+    rule.durationMinutes = offMinute > onMinute ? offMinute - onMinute : offMinute + 24 * 60 - onMinute;
+    rule.dayMask = EVERY_DAY;
+    rule.repeat = repeatChoice != 1;
+    rule.startDay = startOfDay(now);
+    rule.active = false;
+    rule.pending = 0;
+    rule.pendingOff = 0;
+    if (repeatChoice == 3) {
+        rule.dayMask = WEEKDAYS;
+    } else if (repeatChoice == 4) {
+        rule.dayMask = WEEKENDS;
+    } else if (repeatChoice == 5) {
+        std::string days;
+        std::cout << "Enter days: ";
+        std::cin >> days;
+        if (!parseDayMask(days, rule.dayMask)) {
+            std::cout << "Invalid days. Use names (sun..sat) or numbers (0..6), e.g. mon-fri.\n";
+            return;
+        }
+    }
 
-    // Update device status based on current time
-    std::time_t current_time = std::time(nullptr);
+    // Schedule the device; occurrences are expanded one at a time by the scheduler
+    size_t ruleId;
+    bool running;
+    {
+        std::lock_guard<std::mutex> lock(home.mutex);
+        // Keep the scheduled load under the power cap, starting later if needed
+        int requestedMinute = rule.onMinute;
+        if (!fitSchedule(home, rule, LOAD_DELAY)) {
+            std::cout << "Cannot schedule \"" << selectedDevice.name() << "\": it would take the scheduled load over "
+                << "the power cap of " << home.tariff.powerCap << " W at any start within a day.\n";
+            return;
+        }
+        if (rule.onMinute != requestedMinute) {
+            std::ostringstream on, off;
+            int offMinute = (rule.onMinute + rule.durationMinutes) % (24 * 60);
+            on << std::setfill('0') << std::setw(2) << rule.onMinute / 60 << ':' << std::setw(2) << rule.onMinute % 60;
+            off << std::setfill('0') << std::setw(2) << offMinute / 60 << ':' << std::setw(2) << offMinute % 60;
+            std::cout << "Moved to start at " << on.str() << " to stay under the power cap of "
+                << home.tariff.powerCap << " W.\n";
+            onTimeStr = on.str();
+            offTimeStr = off.str();
+        }
+        ruleId = addSchedule(home, rule, now);
+        running = selectedDevice.status();
+    }
 
-    if (difftime(on_time, current_time) <= 0 && difftime(off_time, current_time) > 0) {
-        // Current time is between ON and OFF time
-        selectedDevice.status = true;
-        std::cout << "Device \"" << selectedDevice.name << "\" is currently ON.\n";
-    } else if (difftime(off_time, current_time) <= 0) {
-        // OFF time is in the past
-        selectedDevice.status = false;
-        std::cout << "Device \"" << selectedDevice.name << "\" is currently OFF.\n";
+    std::cout << "Device \"" << selectedDevice.name() << "\" scheduled from "
+        << onTimeStr << " to " << offTimeStr << " (schedule #" << (ruleId + 1) << ").\n";
+
+    // Show the next few occurrences
+    int shown = 0;
+    forEachOccurrence(rule, now, now + 8 * 24 * 3600, [&](const ActivationRecord& occurrence) {
+        if (shown++ < 3) {
+            std::tm on = localTime(occurrence.onTime);
+            std::tm off = localTime(occurrence.offTime);
+            std::cout << " - " << std::put_time(&on, "%a %d %b %H:%M") << " to "
+                << std::put_time(&off, "%a %d %b %H:%M") << "\n";
+        }
+    });
+
+    if (running) {
+        std::cout << "Device \"" << selectedDevice.name() << "\" is currently ON.\n";
+    } else if (shown == 0) {
+        std::cout << "Device \"" << selectedDevice.name() << "\" is currently OFF.\n";
     } else {
-        // Device is scheduled for future activation
-        selectedDevice.status = false;
-        std::cout << "Device \"" << selectedDevice.name << "\" will turn ON at " << onTimeStr << ".\n";
+        std::cout << "Device \"" << selectedDevice.name() << "\" will turn ON at " << onTimeStr << ".\n";
     }
 }
 
 // Enquire Device Status function
-void enquireDeviceStatus(const std::vector<Room>& rooms) {
-    std::cout << "####################################################\n";
-    std::cout << " Welcome to mySmart Home\n";
-    std::cout << "Device Status\n";
-    for (const auto& room : rooms) {
-        std::cout << "Room: " << room.name << "\n";
-        for (const auto& device : room.devices) {
-            std::cout << " - " << device.name << ": " << (device.status ? "ON" : "OFF") << "\n";
-        }
-    }
-    std::cout << currentDateTime();
-    std::cout << "\n####################################################\n";
+void enquireDeviceStatus(const Home& home) {
+    beginScreen("Device Status");
+    writeStatus(home, FORMAT_TEXT, screen);
+    endScreen(home);
 }
 
 // Display Reports function
-void displayReports(const std::vector<Room>& rooms) {
-    const double ratePerUnit = 0.009; // Fils per kWh
-    std::cout << "####################################################\n";
-    std::cout << " Welcome to mySmart Home\n";
-    std::cout << "Reports\n";
-    double totalEnergy = 0.0;
-    for (const auto& room : rooms) {
-        double roomEnergy = 0.0;
-        for (const auto& device : room.devices) {
-            double energy = device.calculateEnergyConsumed();
-            roomEnergy += energy;
-        }
-        totalEnergy += roomEnergy;
-        std::cout << "Energy consumed in " << room.name << ": "
-            << roomEnergy << " kWh\n";
-    }
-    double totalCost = totalEnergy * ratePerUnit;
-    std::cout << "Total Energy Consumed: " << totalEnergy << " kWh\n";
-    std::cout << "Total Cost: " << totalCost << " Fils\n";
-    std::cout << currentDateTime();
-    std::cout << "\n####################################################\n";
+void displayReports(const Home& home) {
+    std::time_t now = home.now();
+    std::unique_lock<std::mutex> lock(home.mutex);
+    UsageSummary summary = aggregateUsage(home, now, 0);
+    UsageCost cost = computeCosts(home, summary);
+    double planned = plannedEnergy(home, now, now + 24 * 3600);
+    std::vector<double> recentDeviceEnergy = energyInRange(home, now - 7 * 24 * 3600, now, now);
+    lock.unlock();
+    std::vector<double> recentRoomEnergy(home.rooms.size(), 0.0);
+    double recentEnergy = 0.0;
+    for (size_t id = 0; id < recentDeviceEnergy.size(); ++id) {
+        recentRoomEnergy[home.registry.roomIds[id]] += recentDeviceEnergy[id];
+        recentEnergy += recentDeviceEnergy[id];
+    }
+    beginScreen("Reports");
+    for (const auto& roomUsage : summary.rooms) {
+        screen += "Energy consumed in ";
+        screen += home.rooms[roomUsage.roomIndex].name;
+        screen += ": ";
+        appendNumber(screen, roomUsage.energy, SCREEN_DIGITS);
+        screen += " kWh (";
+        appendNumber(screen, cost.rooms[roomUsage.roomIndex], SCREEN_DIGITS);
+        screen += " Fils)\n";
+    }
+    screen += "Total Energy Consumed: ";
+    appendNumber(screen, summary.totalEnergy, SCREEN_DIGITS);
+    screen += " kWh\nTotal Cost: ";
+    appendNumber(screen, cost.total, SCREEN_DIGITS);
+    screen += " Fils\nScheduled energy for the next 24 hours: ";
+    appendNumber(screen, planned, SCREEN_DIGITS);
+    screen += " kWh\nLast 7 days:\n";
+    for (size_t r = 0; r < home.rooms.size(); ++r) {
+        screen += " - ";
+        screen += home.rooms[r].name;
+        screen += ": ";
+        appendNumber(screen, recentRoomEnergy[r], SCREEN_DIGITS);
+        screen += " kWh\n";
+    }
+    screen += " - Total: ";
+    appendNumber(screen, recentEnergy, SCREEN_DIGITS);
+    screen += " kWh\n";
+    endScreen(home);
+}
+
+// Append "<device> in <room>" without building temporary strings
+void appendDeviceName(std::string& out, const Home& home, size_t id) {
+    out += home.registry.name(id);
+    out += " in ";
+    out += home.rooms[home.registry.roomIds[id]].name;
 }
 
 // Display Trends function
-void displayTrends(const std::vector<Room>& rooms) {
-    std::cout << "####################################################\n";
-    std::cout << " Welcome to mySmart Home\n";
-    std::cout << "Trends\n";
+void displayTrends(const Home& home) {
+    std::time_t now = home.now();
+    std::unique_lock<std::mutex> lock(home.mutex);
+    std::vector<TrendEntry> topRooms = home.trends.topEnergyRooms(home.registry, now, 1);
+    std::vector<TrendEntry> topEnergy = home.trends.topEnergyDevices(home.registry, now, 1);
+    std::vector<TrendEntry> topActive = home.trends.topActiveDevices(home.registry, now, 1);
+    std::vector<double> recentEnergy = energyInRange(home, now - 7 * 24 * 3600, now, now);
+    std::vector<Anomaly> anomalies = findAnomalies(home, now);
+    lock.unlock();
+    beginScreen("Trends");
 
     // Which room consumes more energy?
-    std::string highestEnergyRoom = "N/A";
-    double highestEnergy = -1.0;
-    for (const auto& room : rooms) {
-        double roomEnergy = 0.0;
-        for (const auto& device : room.devices) {
-            roomEnergy += device.calculateEnergyConsumed();
-        }
-        if (roomEnergy > highestEnergy) {
-            highestEnergy = roomEnergy;
-            highestEnergyRoom = room.name;
-        }
-    }
-    if (highestEnergy >= 0.0) {
-        std::cout << "Room consuming the most energy: " << highestEnergyRoom
-            << " (" << highestEnergy << " kWh)\n";
+    if (!topRooms.empty()) {
+        screen += "Room consuming the most energy: ";
+        screen += home.rooms[topRooms.front().id].name;
+        screen += " (";
+        appendNumber(screen, topRooms.front().value, SCREEN_DIGITS);
+        screen += " kWh)\n";
     } else {
-        std::cout << "No energy consumption data available.\n";
+        screen += "No energy consumption data available.\n";
     }
 
     // Which device consumes more energy?
-    std::string highestEnergyDevice = "N/A";
-    double highestDeviceEnergy = -1.0;
-    for (const auto& room : rooms) {
-        for (const auto& device : room.devices) {
-            double deviceEnergy = device.calculateEnergyConsumed();
-            if (deviceEnergy > highestDeviceEnergy) {
-                highestDeviceEnergy = deviceEnergy;
-                highestEnergyDevice = device.name + " in " + room.name;
+    if (!topEnergy.empty()) {
+        screen += "Device consuming the most energy: ";
+        appendDeviceName(screen, home, topEnergy.front().id);
+        screen += " (";
+        appendNumber(screen, topEnergy.front().value, SCREEN_DIGITS);
+        screen += " kWh)\n";
+    } else {
+        screen += "No energy consumption data available.\n";
+    }
+
+    // Which device is activated for more time?
+    if (!topActive.empty()) {
+        screen += "Device activated for the longest time: ";
+        appendDeviceName(screen, home, topActive.front().id);
+        screen += " (";
+        appendNumber(screen, topActive.front().value / 3600.0, SCREEN_DIGITS);
+        screen += " hours)\n";
+    } else {
+        screen += "No activation data available.\n";
+    }
+
+    // Which device consumed the most energy recently?
+    size_t recentTop = recentEnergy.size();
+    double recentTopEnergy = 0.0;
+    for (size_t id = 0; id < recentEnergy.size(); ++id) {
+        if (recentEnergy[id] > recentTopEnergy) {
+            recentTop = id;
+            recentTopEnergy = recentEnergy[id];
+        }
+    }
+    if (recentTop < recentEnergy.size()) {
+        screen += "Device consuming the most energy in the last 7 days: ";
+        appendDeviceName(screen, home, recentTop);
+        screen += " (";
+        appendNumber(screen, recentTopEnergy, SCREEN_DIGITS);
+        screen += " kWh)\n";
+    }
+
+    // Which devices are behaving unusually?
+    if (!anomalies.empty()) {
+        screen += "Devices needing attention:\n";
+        for (const auto& anomaly : anomalies) {
+            screen += " - ";
+            appendDeviceName(screen, home, anomaly.deviceId);
+            if (anomaly.kind == ANOMALY_HIGH_POWER) {
+                screen += " last drew ";
+                appendNumber(screen, anomaly.value, SCREEN_DIGITS);
+                screen += " W (usually ";
+                appendNumber(screen, anomaly.usual, SCREEN_DIGITS);
+                screen += " W)\n";
+            } else {
+                screen += anomaly.kind == ANOMALY_LEFT_ON ? " has been on for " : " last ran for ";
+                appendNumber(screen, anomaly.value / 3600.0, SCREEN_DIGITS);
+                screen += " hours (usually ";
+                appendNumber(screen, anomaly.usual / 3600.0, SCREEN_DIGITS);
+                screen += ")\n";
             }
         }
     }
-    if (highestDeviceEnergy >= 0.0) {
-        std::cout << "Device consuming the most energy: " << highestEnergyDevice
-            << " (" << highestDeviceEnergy << " kWh)\n";
-    } else {
-        std::cout << "No energy consumption data available.\n";
+    endScreen(home);
+}
+
+// Usage History function
+void displayUsageHistory(const Home& home) {
+    static const char* const UNIT_NAMES[] = { "hours", "days", "months" };
+    int sizeChoice;
+    int count;
+    int scopeChoice;
+
+    std::cout << "Usage History\n";
+    std::cout << "1. Hourly\n";
+    std::cout << "2. Daily\n";
+    std::cout << "3. Monthly\n";
+    std::cout << "Select bucket size: ";
+    std::cin >> sizeChoice;
+
+    while (std::cin.fail() || sizeChoice < 1 || sizeChoice > 3) {
+        recoverInput();
+        std::cin.ignore(INT_MAX, '\n');
+        std::cout << "Invalid choice. Please enter a number between 1 and 3: ";
+        std::cin >> sizeChoice;
     }
+    BucketSize size = BucketSize(sizeChoice - 1);
 
-    // Which device is activated for more time?
-    std::string longestActiveDevice = "N/A";
-    double longestActiveTime = -1.0;
-    for (const auto& room : rooms) {
-        for (const auto& device : room.devices) {
-            double activeTime = device.totalActiveTime(); 
-            if (activeTime > longestActiveTime) {
-                longestActiveTime = activeTime;
-                longestActiveDevice = device.name + " in " + room.name;
+    std::cout << "How many " << UNIT_NAMES[size] << " back (including the current one)?: ";
+    std::cin >> count;
+
+    while (std::cin.fail() || count <= 0 || count > 1000) {
+        recoverInput();
+        std::cin.ignore(INT_MAX, '\n');
+        std::cout << "Invalid number. Please enter a number between 1 and 1000: ";
+        std::cin >> count;
+    }
+
+    std::cout << "1. Whole home\n";
+    std::cout << "2. A room\n";
+    std::cout << "3. A device\n";
+    std::cout << "Select scope: ";
+    std::cin >> scopeChoice;
+
+    while (std::cin.fail() || scopeChoice < 1 || scopeChoice > 3) {
+        recoverInput();
+        std::cin.ignore(INT_MAX, '\n');
+        std::cout << "Invalid choice. Please enter a number between 1 and 3: ";
+        std::cin >> scopeChoice;
+    }
+
+    UsageScope scope = SCOPE_HOUSE;
+    size_t scopeId = 0;
+    std::string scopeName = "Whole home";
+    if (scopeChoice > 1) {
+        if (home.rooms.empty()) {
+            std::cout << "No rooms available. Please add rooms first.\n";
+            return;
+        }
+        int roomChoice;
+        for (size_t i = 0; i < home.rooms.size(); ++i) {
+            std::cout << (i + 1) << ". " << home.rooms[i].name << "\n";
+        }
+        std::cout << "Select a room: ";
+        std::cin >> roomChoice;
+
+        while (std::cin.fail() || roomChoice < 1 || roomChoice > (int)home.rooms.size()) {
+            recoverInput();
+            std::cin.ignore(INT_MAX, '\n');
+            std::cout << "Invalid room selection. Please try again: ";
+            std::cin >> roomChoice;
+        }
+        const Room& selectedRoom = home.rooms[roomChoice - 1];
+        scope = SCOPE_ROOM;
+        scopeId = roomChoice - 1;
+        scopeName = selectedRoom.name;
+
+        if (scopeChoice == 3) {
+            if (selectedRoom.devices.empty()) {
+                std::cout << "No devices in this room. Please add devices first.\n";
+                return;
+            }
+            int deviceChoice;
+            for (size_t i = 0; i < selectedRoom.devices.size(); ++i) {
+                std::cout << (i + 1) << ". " << selectedRoom.devices[i].name() << "\n";
             }
+            std::cout << "Select a device: ";
+            std::cin >> deviceChoice;
+
+            while (std::cin.fail() || deviceChoice < 1 || deviceChoice > (int)selectedRoom.devices.size()) {
+                recoverInput();
+                std::cin.ignore(INT_MAX, '\n');
+                std::cout << "Invalid device selection. Please try again: ";
+                std::cin >> deviceChoice;
+            }
+            const Device& selectedDevice = selectedRoom.devices[deviceChoice - 1];
+            scope = SCOPE_DEVICE;
+            scopeId = selectedDevice.id();
+            scopeName = selectedDevice.name() + " in " + selectedRoom.name;
         }
     }
-    if (longestActiveTime >= 0.0) {
-        std::cout << "Device activated for the longest time: " << longestActiveDevice
-            << " (" << longestActiveTime / 3600.0 << " hours)\n";
+
+    // Step back from the current bucket to the first one requested
+    std::time_t now = home.now();
+    std::time_t from = bucketStart(size, now);
+    if (size == BUCKET_HOUR) {
+        from -= std::time_t(count - 1) * 3600;
     } else {
-        std::cout << "No activation data available.\n";
+        std::tm tm = localTime(from);
+        tm.tm_isdst = -1;
+        if (size == BUCKET_DAY) {
+            tm.tm_mday -= count - 1;
+        } else {
+            tm.tm_mon -= count - 1;
+        }
+        from = std::mktime(&tm);
     }
 
-    std::cout << currentDateTime();
-    std::cout << "\n####################################################\n";
+    std::unique_lock<std::mutex> lock(home.mutex);
+    std::vector<BucketUsage> usage = queryUsage(home, size, from, now + 1, scope, scopeId, now);
+    lock.unlock();
+
+    static const char* const FORMATS[] = { "%Y-%m-%d %H:00", "%Y-%m-%d", "%Y-%m" };
+    beginScreen("Usage History - ", scopeName);
+    for (const auto& bucket : usage) {
+        std::tm start = localTime(bucket.start);
+        char label[32];
+        screen.append(label, std::strftime(label, sizeof(label), FORMATS[size], &start));
+        screen += ": ";
+        appendNumber(screen, bucket.energy, SCREEN_DIGITS);
+        screen += " kWh, ";
+        appendNumber(screen, bucket.activeSeconds / 3600.0, SCREEN_DIGITS);
+        screen += " hours\n";
+    }
+    endScreen(home);
 }
 
-void updateFeatures(std::vector<Room>& rooms) {
+void updateFeatures(Home& /*home*/) {
     std::cout << "Update Features - Functionality not implemented yet.\n";
 }
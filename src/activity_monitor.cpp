@@ -0,0 +1,93 @@
+//Project name : Smart Home Automation
+//file name : activity_monitor.cpp
+
+#include "activity_monitor.h"
+
+namespace {
+
+void writeStat(ByteWriter& out, const RollingStat& stat) {
+    out.put(stat.mean);
+    out.put(stat.variance);
+    out.put(stat.count);
+}
+
+bool readStat(ByteReader& in, RollingStat& stat) {
+    return in.get(stat.mean) && in.get(stat.variance) && in.get(stat.count);
+}
+
+} // namespace
+
+const std::uint32_t ActivityMonitor::NOT_FLAGGED;
+
+void ActivityMonitor::switchedOff(size_t id, std::time_t onTime, std::time_t offTime, double energy) {
+    DeviceActivity& device = devices[id];
+    double seconds = difftime(offTime, onTime);
+    device.lastDuration = seconds;
+    device.usualDuration = device.duration.mean;
+    device.flags = 0;
+    if (seconds > device.duration.limit()) {
+        device.flags |= ANOMALY_LONG_RUN;
+    }
+    device.duration.add(seconds);
+    if (seconds > 0.0 && device.onTime == onTime) {
+        device.lastPower = (energy - device.energyAtOn) * 1000.0 / (seconds / 3600.0);
+        device.usualPower = device.power.mean;
+        if (device.lastPower > device.power.limit()) {
+            device.flags |= ANOMALY_HIGH_POWER;
+        }
+        device.power.add(device.lastPower);
+    }
+    if (device.flags) {
+        device.flaggedAt = offTime;
+    }
+    setFlagged(id, device.flags != 0);
+}
+
+void ActivityMonitor::setFlagged(size_t id, bool on) {
+    if (on && flaggedSlots[id] == NOT_FLAGGED) {
+        flaggedSlots[id] = static_cast<std::uint32_t>(flagged.size());
+        flagged.push_back(static_cast<std::uint32_t>(id));
+    } else if (!on && flaggedSlots[id] != NOT_FLAGGED) {
+        flagged[flaggedSlots[id]] = flagged.back();
+        flaggedSlots[flagged.back()] = flaggedSlots[id];
+        flagged.pop_back();
+        flaggedSlots[id] = NOT_FLAGGED;
+    }
+}
+
+void ActivityMonitor::write(ByteWriter& out) const {
+    out.put(static_cast<std::uint32_t>(devices.size()));
+    for (const auto& device : devices) {
+        writeStat(out, device.duration);
+        writeStat(out, device.power);
+        out.put(device.onTime);
+        out.put(device.energyAtOn);
+        out.put(device.lastDuration);
+        out.put(device.lastPower);
+        out.put(device.usualDuration);
+        out.put(device.usualPower);
+        out.put(device.flaggedAt);
+        out.put(device.flags);
+    }
+}
+
+bool ActivityMonitor::read(ByteReader& in, size_t deviceCount) {
+    std::uint32_t count;
+    if (!in.get(count) || count != deviceCount) {
+        return false;
+    }
+    devices.assign(count, DeviceActivity());
+    flagged.clear();
+    flaggedSlots.assign(count, NOT_FLAGGED);
+    for (size_t id = 0; id < devices.size(); ++id) {
+        DeviceActivity& device = devices[id];
+        if (!readStat(in, device.duration) || !readStat(in, device.power) || !in.get(device.onTime)
+            || !in.get(device.energyAtOn) || !in.get(device.lastDuration) || !in.get(device.lastPower)
+            || !in.get(device.usualDuration) || !in.get(device.usualPower) || !in.get(device.flaggedAt)
+            || !in.get(device.flags)) {
+            return false;
+        }
+        setFlagged(id, device.flags != 0);
+    }
+    return true;
+}
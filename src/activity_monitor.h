@@ -0,0 +1,121 @@
+//Project name : Smart Home Automation
+//file name : activity_monitor.h
+
+#ifndef SMART_HOME_ACTIVITY_MONITOR_H
+#define SMART_HOME_ACTIVITY_MONITOR_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <ctime>
+#include <limits>
+#include <vector>
+
+#include "journal.h"
+
+const double ACTIVITY_WEIGHT = 0.1;          // weight of the newest activation in the rolling statistics
+const std::uint32_t ACTIVITY_WARMUP = 5;     // activations seen before a device can be flagged
+const double ANOMALY_SIGMAS = 3.0;           // standard deviations above the mean that count as unusual
+const double ANOMALY_MIN_SPREAD = 0.25;      // floor on the deviation, as a fraction of the mean
+
+// Why a device was flagged
+enum AnomalyFlag {
+    ANOMALY_LONG_RUN = 1,      // its last activation ran far longer than usual
+    ANOMALY_HIGH_POWER = 2,    // its last activation drew far more power than usual
+    ANOMALY_LEFT_ON = 4        // it is still ON well past its usual run
+};
+
+// Exponentially weighted mean and variance of one quantity
+struct RollingStat {
+    double mean;
+    double variance;
+    std::uint32_t count;
+
+    RollingStat() : mean(0.0), variance(0.0), count(0) {}
+
+    void add(double value) {
+        if (count == 0) {
+            mean = value;
+        } else {
+            double difference = value - mean;
+            double increment = ACTIVITY_WEIGHT * difference;
+            mean += increment;
+            variance = (1.0 - ACTIVITY_WEIGHT) * (variance + difference * increment);
+        }
+        if (count < UINT32_MAX) {
+            ++count;
+        }
+    }
+
+    // Values above this are unusual; infinite until enough have been seen
+    double limit() const {
+        if (count < ACTIVITY_WARMUP) {
+            return std::numeric_limits<double>::infinity();
+        }
+        return mean + ANOMALY_SIGMAS * std::max(std::sqrt(variance), ANOMALY_MIN_SPREAD * mean);
+    }
+};
+
+// Rolling statistics of each device's activations, updated in O(1) as each
+// record closes: the ON duration and the average power drawn while ON.
+// Devices whose activation lands far above their own baseline are flagged
+// until their next activation, and listed so they can be found without a
+// sweep over the house.
+class ActivityMonitor {
+public:
+    // What the monitor knows about one device
+    struct DeviceActivity {
+        RollingStat duration;          // seconds per activation
+        RollingStat power;             // average watts per activation
+        std::int64_t onTime;           // start of the activation seen turning ON
+        double energyAtOn;             // device energy (kWh) at that moment
+        double lastDuration;
+        double lastPower;
+        double usualDuration;          // means before the last activation was folded in
+        double usualPower;
+        std::int64_t flaggedAt;        // OFF time of the flagged activation
+        std::uint8_t flags;            // AnomalyFlag bits of the last activation
+
+        DeviceActivity() : onTime(0), energyAtOn(0.0), lastDuration(0.0), lastPower(0.0),
+            usualDuration(0.0), usualPower(0.0), flaggedAt(0), flags(0) {}
+    };
+
+    void addDevice() {
+        devices.push_back(DeviceActivity());
+        flaggedSlots.push_back(NOT_FLAGGED);
+    }
+
+    size_t size() const { return devices.size(); }
+
+    const DeviceActivity& device(size_t id) const { return devices[id]; }
+
+    // Devices whose last activation was flagged, in no particular order
+    const std::vector<std::uint32_t>& flaggedDevices() const { return flagged; }
+
+    // Remember the device's energy total as it turns ON
+    void switchedOn(size_t id, std::time_t at, double energy) {
+        devices[id].onTime = at;
+        devices[id].energyAtOn = energy;
+    }
+
+    // Judge the activation [onTime, offTime) against the device's statistics,
+    // then fold it in. 'energy' is the device's energy total after the record
+    // closed; the power is only judged if the monitor saw the activation start.
+    void switchedOff(size_t id, std::time_t onTime, std::time_t offTime, double energy);
+
+    void write(ByteWriter& out) const;
+
+    // Read statistics written by write() for 'deviceCount' devices
+    bool read(ByteReader& in, size_t deviceCount);
+
+private:
+    static const std::uint32_t NOT_FLAGGED = UINT32_MAX;
+
+    std::vector<DeviceActivity> devices;   // indexed by device id
+    std::vector<std::uint32_t> flagged;
+    std::vector<std::uint32_t> flaggedSlots;   // index into 'flagged', by device id
+
+    void setFlagged(size_t id, bool on);
+};
+
+#endif // SMART_HOME_ACTIVITY_MONITOR_H
@@ -0,0 +1,24 @@
+//Project name : Smart Home Automation
+//file name : alloc_counter.cpp
+
+#include "alloc_counter.h"
+
+#include <cstdlib>
+#include <new>
+
+std::atomic<std::uint64_t> heapAllocations(0);
+
+// Replacements for the global allocation functions; operator new[] and the
+// other forms forward to these
+void* operator new(std::size_t size) {
+    heapAllocations.fetch_add(1, std::memory_order_relaxed);
+    void* memory = std::malloc(size ? size : 1);
+    if (!memory) {
+        throw std::bad_alloc();
+    }
+    return memory;
+}
+
+void operator delete(void* memory) noexcept {
+    std::free(memory);
+}
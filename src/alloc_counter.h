@@ -0,0 +1,14 @@
+//Project name : Smart Home Automation
+//file name : alloc_counter.h
+
+#ifndef SMART_HOME_ALLOC_COUNTER_H
+#define SMART_HOME_ALLOC_COUNTER_H
+
+#include <atomic>
+#include <cstdint>
+
+// Count of heap allocations made by the process, reported by the "stats"
+// command to check that hot paths do not allocate
+extern std::atomic<std::uint64_t> heapAllocations;
+
+#endif // SMART_HOME_ALLOC_COUNTER_H
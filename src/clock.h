@@ -0,0 +1,44 @@
+//Project name : Smart Home Automation
+//file name : clock.h
+
+#ifndef SMART_HOME_CLOCK_H
+#define SMART_HOME_CLOCK_H
+
+#include <atomic>
+#include <ctime>
+
+// Where "now" comes from. Code that needs the current time asks the home's
+// clock instead of calling std::time, so a run can be moved onto a virtual
+// clock and replayed exactly.
+class Clock {
+public:
+    virtual ~Clock() {}
+    virtual std::time_t now() const = 0;
+};
+
+// The wall clock
+class SystemClock : public Clock {
+public:
+    std::time_t now() const override { return std::time(nullptr); }
+};
+
+// A clock that only moves when told to. Reading it is safe from any thread.
+class VirtualClock : public Clock {
+public:
+    explicit VirtualClock(std::time_t start) : current(start) {}
+
+    std::time_t now() const override { return current.load(std::memory_order_acquire); }
+
+    void set(std::time_t t) { current.store(t, std::memory_order_release); }
+
+private:
+    std::atomic<std::time_t> current;
+};
+
+// The wall clock shared by every home that is not given another one
+inline const Clock& systemClock() {
+    static const SystemClock clock;
+    return clock;
+}
+
+#endif // SMART_HOME_CLOCK_H
@@ -0,0 +1,609 @@
+//Project name : Smart Home Automation
+//file name : commands.cpp
+
+#include "commands.h"
+
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+
+#include "metrics.h"
+#include "simulation.h"
+
+// A word of a command line, pointing into the line buffer
+struct Token {
+    const char* data;
+    size_t size;
+
+    bool is(const char* text) const {
+        return std::strlen(text) == size && std::memcmp(data, text, size) == 0;
+    }
+
+    bool is(const std::string& text) const {
+        return text.size() == size && std::memcmp(data, text.data(), size) == 0;
+    }
+
+    std::string str() const { return std::string(data, size); }
+};
+
+// Split a line on blanks; returns the number of tokens stored
+size_t tokenize(const std::string& line, Token* tokens, size_t maxTokens) {
+    size_t count = 0;
+    const char* p = line.data();
+    const char* end = p + line.size();
+    while (p < end && count < maxTokens) {
+        while (p < end && (*p == ' ' || *p == '\t' || *p == '\r')) {
+            ++p;
+        }
+        if (p == end) {
+            break;
+        }
+        const char* start = p;
+        while (p < end && *p != ' ' && *p != '\t' && *p != '\r') {
+            ++p;
+        }
+        tokens[count].data = start;
+        tokens[count].size = static_cast<size_t>(p - start);
+        ++count;
+    }
+    return count;
+}
+
+bool parseNumber(const Token& token, double& value) {
+    char* end;
+    value = std::strtod(token.data, &end);
+    return token.size > 0 && end == token.data + token.size;
+}
+
+bool parseInteger(const Token& token, long long& value) {
+    char* end;
+    value = std::strtoll(token.data, &end, 10);
+    return token.size > 0 && end == token.data + token.size;
+}
+
+// Parse "@<unix time>"; the time must be after 0, which the registry keeps
+// as "no open record"
+bool parseStamp(Token token, std::time_t& at) {
+    long long value;
+    if (token.size < 2 || token.data[0] != '@') {
+        return false;
+    }
+    ++token.data;
+    --token.size;
+    if (!parseInteger(token, value) || value <= 0) {
+        return false;
+    }
+    at = static_cast<std::time_t>(value);
+    return true;
+}
+
+// Parse "HH:MM" into minutes after midnight
+bool parseClock(const Token& token, int& minutes) {
+    if (token.size != 5 || token.data[2] != ':') {
+        return false;
+    }
+    for (size_t i = 0; i < 5; ++i) {
+        if (i != 2 && !std::isdigit(static_cast<unsigned char>(token.data[i]))) {
+            return false;
+        }
+    }
+    int hours = (token.data[0] - '0') * 10 + (token.data[1] - '0');
+    int mins = (token.data[3] - '0') * 10 + (token.data[4] - '0');
+    if (hours > 23 || mins > 59) {
+        return false;
+    }
+    minutes = hours * 60 + mins;
+    return true;
+}
+
+// Look up a room, and optionally a device in it, by name. Returns false
+// with a message in 'error' if either is unknown. Caller holds home.mutex.
+bool resolveDevice(const Home& home, const Token& roomName, const Token* deviceName,
+                   size_t& roomIndex, size_t& deviceId, std::string& error) {
+    roomIndex = home.findRoom(roomName.str());
+    if (roomIndex == Home::NO_ROOM) {
+        error = "unknown room " + roomName.str();
+        return false;
+    }
+    if (deviceName) {
+        deviceId = home.findDevice(roomIndex, deviceName->str());
+        if (deviceId == Home::NO_DEVICE) {
+            error = "unknown device " + deviceName->str() + " in " + roomName.str();
+            return false;
+        }
+    }
+    return true;
+}
+
+const char* const BATCH_HELP =
+    "Commands:\n"
+    "  add-room <room>\n"
+    "  add-device <room> <device> <watts>\n"
+    "  on|off|toggle <room> <device> [@<unix time>]\n"
+    "  schedule <room> <device> <HH:MM> <HH:MM> [once|daily|weekdays|weekends|<cron day-of-week>] [--delay|--cheapest]\n"
+    "  cancel <schedule number>\n"
+    "  status [--json|--csv]\n"
+    "  report [--json|--csv]\n"
+    "  trends [<count>] [--json|--csv]\n"
+    "  anomalies [--json|--csv]\n"
+    "  usage hour|day|month <from unix time> <to unix time> [<room> [<device>]] [--json|--csv]\n"
+    "  sample <room> <device> <watts> [@<unix time>]\n"
+    "  ingest <trace file>\n"
+    "  tariff [<file>]\n"
+    "  advance <seconds>|@<unix time>\n"
+    "  simulate <rooms> <devices per room> <toggles per device per day> <days> [<seed>]\n"
+    "  stats [--json|--csv]\n"
+    "  metrics [<file>] [--json]\n"
+    "  help\n"
+    "  quit\n";
+
+bool executeCommand(Home& home, const std::string& line, CommandOrigin origin, std::string& out,
+                    std::string& error, bool& quit) {
+    SMART_HOME_TIMED(METRIC_COMMAND);
+    const size_t MAX_TOKENS = 8;
+    Token tokens[MAX_TOKENS];
+    size_t count = tokenize(line, tokens, MAX_TOKENS);
+    if (count == 0 || tokens[0].data[0] == '#') {
+        return true;
+    }
+    ReportFormat format = FORMAT_TEXT;
+    if (count > 1 && (tokens[count - 1].is("--json") || tokens[count - 1].is("--csv"))) {
+        format = tokens[count - 1].is("--json") ? FORMAT_JSON : FORMAT_CSV;
+        --count;
+    }
+    const Token& command = tokens[0];
+    std::time_t now = home.now();
+    bool namesFile = command.is("ingest") || ((command.is("tariff") || command.is("metrics")) && count == 2);
+    if (namesFile && origin != ORIGIN_LOCAL) {
+        error = command.str() + " with a file name is only available in batch mode";
+        return false;
+    }
+
+    if (command.is("on") || command.is("off") || command.is("toggle")) {
+        if (count < 3 || count > 4) {
+            error = "usage: " + command.str() + " <room> <device> [@<unix time>]";
+            return false;
+        }
+        std::time_t at = now;
+        if (count == 4 && !parseStamp(tokens[3], at)) {
+            error = "invalid time " + tokens[3].str();
+            return false;
+        }
+        std::lock_guard<std::mutex> lock(home.mutex);
+        size_t roomIndex, deviceId;
+        if (!resolveDevice(home, tokens[1], &tokens[2], roomIndex, deviceId, error)) {
+            return false;
+        }
+        bool running = home.registry.status(deviceId);
+        bool turnOn = command.is("toggle") ? !running : command.is("on");
+        if (!turnOn && running && at < home.registry.openOnTimes[deviceId]) {
+            error = "OFF time is before the device was turned ON";
+            return false;
+        }
+        switchDevice(home, deviceId, turnOn, at);
+        return true;
+    }
+
+    if (command.is("status")) {
+        writeStatus(home, format, out);
+        return true;
+    }
+
+    if (command.is("report")) {
+        std::lock_guard<std::mutex> lock(home.mutex);
+        writeReport(home, now, format, out);
+        return true;
+    }
+
+    if (command.is("trends")) {
+        long long topN = 1;
+        if (count > 2 || (count == 2 && (!parseInteger(tokens[1], topN) || topN <= 0))) {
+            error = "usage: trends [<count>] [--json|--csv]";
+            return false;
+        }
+        std::lock_guard<std::mutex> lock(home.mutex);
+        writeTrends(home, now, static_cast<size_t>(topN), format, out);
+        return true;
+    }
+
+    if (command.is("anomalies")) {
+        if (count != 1) {
+            error = "usage: anomalies [--json|--csv]";
+            return false;
+        }
+        std::lock_guard<std::mutex> lock(home.mutex);
+        writeAnomalies(home, now, format, out);
+        return true;
+    }
+
+    if (command.is("add-room")) {
+        if (count != 2) {
+            error = "usage: add-room <room>";
+            return false;
+        }
+        std::lock_guard<std::mutex> lock(home.mutex);
+        if (home.findRoom(tokens[1].str()) != Home::NO_ROOM) {
+            error = "room " + tokens[1].str() + " already exists";
+            return false;
+        }
+        home.addRoom(tokens[1].str());
+        return true;
+    }
+
+    if (command.is("add-device")) {
+        double powerRating;
+        if (count != 4 || !parseNumber(tokens[3], powerRating) || !(powerRating > 0) || !std::isfinite(powerRating)) {
+            error = "usage: add-device <room> <device> <watts>";
+            return false;
+        }
+        std::lock_guard<std::mutex> lock(home.mutex);
+        size_t roomIndex, deviceId;
+        if (!resolveDevice(home, tokens[1], nullptr, roomIndex, deviceId, error)) {
+            return false;
+        }
+        if (home.findDevice(roomIndex, tokens[2].str()) != Home::NO_DEVICE) {
+            error = "device " + tokens[2].str() + " already exists in " + tokens[1].str();
+            return false;
+        }
+        home.addDevice(roomIndex, tokens[2].str(), powerRating);
+        return true;
+    }
+
+    if (command.is("schedule")) {
+        ScheduleRule rule;
+        int offMinute;
+        LoadPolicy policy = LOAD_REJECT;
+        if (count > 5 && (tokens[count - 1].is("--delay") || tokens[count - 1].is("--cheapest"))) {
+            policy = tokens[count - 1].is("--delay") ? LOAD_DELAY : LOAD_CHEAPEST;
+            --count;
+        }
+        if (count < 5 || count > 6 || !parseClock(tokens[3], rule.onMinute) || !parseClock(tokens[4], offMinute)
+            || offMinute == rule.onMinute) {
+            error = "usage: schedule <room> <device> <HH:MM> <HH:MM> [once|daily|weekdays|weekends|<days>]"
+                    " [--delay|--cheapest]";
+            return false;
+        }
+        rule.durationMinutes = offMinute > rule.onMinute ? offMinute - rule.onMinute : offMinute + 24 * 60 - rule.onMinute;
+        rule.dayMask = EVERY_DAY;
+        rule.repeat = true;
+        rule.startDay = startOfDay(now);
+        rule.active = false;
+        rule.pending = 0;
+        rule.pendingOff = 0;
+        if (count == 6) {
+            const Token& repeat = tokens[5];
+            if (repeat.is("once")) {
+                rule.repeat = false;
+            } else if (repeat.is("weekdays")) {
+                rule.dayMask = WEEKDAYS;
+            } else if (repeat.is("weekends")) {
+                rule.dayMask = WEEKENDS;
+            } else if (!repeat.is("daily") && !parseDayMask(repeat.str(), rule.dayMask)) {
+                error = "invalid repeat " + repeat.str();
+                return false;
+            }
+        } else {
+            rule.repeat = false;
+        }
+        std::lock_guard<std::mutex> lock(home.mutex);
+        size_t roomIndex;
+        if (!resolveDevice(home, tokens[1], &tokens[2], roomIndex, rule.deviceId, error)) {
+            return false;
+        }
+        int requestedMinute = rule.onMinute;
+        if (!fitSchedule(home, rule, policy)) {
+            error = "schedule would take the load over the power cap of ";
+            appendNumber(error, home.tariff.powerCap);
+            error += " W";
+            return false;
+        }
+        size_t ruleId = addSchedule(home, rule, now);
+        out += "schedule ";
+        appendInteger(out, static_cast<long long>(ruleId + 1));
+        if (rule.onMinute != requestedMinute) {
+            char start[16];
+            std::snprintf(start, sizeof(start), "%02d:%02d", rule.onMinute / 60, rule.onMinute % 60);
+            out += " moved to ";
+            out += start;
+        }
+        out += '\n';
+        return true;
+    }
+
+    if (command.is("cancel")) {
+        long long number;
+        if (count != 2 || !parseInteger(tokens[1], number) || number <= 0) {
+            error = "usage: cancel <schedule number>";
+            return false;
+        }
+        std::lock_guard<std::mutex> lock(home.mutex);
+        if (!cancelSchedule(home, static_cast<size_t>(number - 1))) {
+            error = "no active schedule " + tokens[1].str();
+            return false;
+        }
+        return true;
+    }
+
+    if (command.is("usage")) {
+        static const char* const SIZE_NAMES[] = { "hour", "day", "month" };
+        int size = -1;
+        for (int i = 0; count > 1 && i < 3; ++i) {
+            if (tokens[1].is(SIZE_NAMES[i])) {
+                size = i;
+            }
+        }
+        long long from, to;
+        if (size < 0 || count < 4 || count > 6 || !parseInteger(tokens[2], from) || !parseInteger(tokens[3], to)
+            || to <= from) {
+            error = "usage: usage hour|day|month <from> <to> [<room> [<device>]] [--json|--csv]";
+            return false;
+        }
+        std::lock_guard<std::mutex> lock(home.mutex);
+        UsageScope scope = SCOPE_HOUSE;
+        size_t scopeId = 0;
+        if (count >= 5) {
+            size_t deviceId;
+            if (!resolveDevice(home, tokens[4], count == 6 ? &tokens[5] : nullptr, scopeId, deviceId, error)) {
+                return false;
+            }
+            scope = SCOPE_ROOM;
+            if (count == 6) {
+                scope = SCOPE_DEVICE;
+                scopeId = deviceId;
+            }
+        }
+        writeUsage(home, BucketSize(size), static_cast<std::time_t>(from), static_cast<std::time_t>(to),
+            scope, scopeId, now, format, out);
+        return true;
+    }
+
+    if (command.is("sample")) {
+        double watts;
+        if (count < 4 || count > 5 || !parseNumber(tokens[3], watts)) {
+            error = "usage: sample <room> <device> <watts> [@<unix time>]";
+            return false;
+        }
+        std::time_t at = now;
+        if (count == 5 && !parseStamp(tokens[4], at)) {
+            error = "invalid time " + tokens[4].str();
+            return false;
+        }
+        std::lock_guard<std::mutex> lock(home.mutex);
+        size_t roomIndex, deviceId;
+        if (!resolveDevice(home, tokens[1], &tokens[2], roomIndex, deviceId, error)) {
+            return false;
+        }
+        if (!home.telemetry.record(deviceId, at, watts)) {
+            error = "sample is not after the device's last sample or not a valid reading";
+            return false;
+        }
+        home.trends.update(home.registry, deviceId);
+        return true;
+    }
+
+    if (command.is("ingest")) {
+        if (count != 2) {
+            error = "usage: ingest <trace file>";
+            return false;
+        }
+        std::string path = tokens[1].str();
+        std::FILE* file = std::fopen(path.c_str(), "rb");
+        if (!file) {
+            error = "cannot open " + path;
+            return false;
+        }
+        // The lock is taken once per buffer of the trace, so other clients
+        // get in between
+        TraceReader reader(file);
+        std::vector<TraceReader::Meter> meters;
+        std::vector<TraceReader::Sample> samples;
+        std::vector<size_t> channels;
+        size_t accepted = 0;
+        size_t ignored = 0;
+        while (reader.next(meters, samples, error)) {
+            std::lock_guard<std::mutex> lock(home.mutex);
+            for (const auto& meter : meters) {
+                Token room = { meter.room.data(), meter.room.size() };
+                Token device = { meter.device.data(), meter.device.size() };
+                size_t roomIndex;
+                if (channels.size() <= meter.channel) {
+                    channels.resize(meter.channel + 1, Home::NO_DEVICE);
+                }
+                if (!resolveDevice(home, room, &device, roomIndex, channels[meter.channel], error)) {
+                    std::fclose(file);
+                    return false;
+                }
+            }
+            for (const auto& sample : samples) {
+                if (home.telemetry.record(channels[sample.channel], sample.time, sample.watts)) {
+                    home.trends.update(home.registry, channels[sample.channel]);
+                    ++accepted;
+                } else {
+                    ++ignored;
+                }
+            }
+        }
+        std::fclose(file);
+        if (!error.empty()) {
+            error = path + " " + error;
+            return false;
+        }
+        std::lock_guard<std::mutex> lock(home.mutex);
+        home.telemetry.flush();
+        out += "ingested ";
+        appendInteger(out, static_cast<long long>(accepted));
+        out += " samples, ignored ";
+        appendInteger(out, static_cast<long long>(ignored));
+        out += '\n';
+        return true;
+    }
+
+    if (command.is("tariff")) {
+        if (count > 2) {
+            error = "usage: tariff [<file>]";
+            return false;
+        }
+        std::lock_guard<std::mutex> lock(home.mutex);
+        if (count == 2) {
+            return loadTariff(tokens[1].str(), home.tariff, error);
+        }
+        out += formatTariff(home.tariff);
+        return true;
+    }
+
+    if (command.is("advance")) {
+        std::time_t to;
+        long long seconds;
+        if (count != 2 || (!parseStamp(tokens[1], to) && (!parseInteger(tokens[1], seconds) || seconds < 0))) {
+            error = "usage: advance <seconds>|@<unix time>";
+            return false;
+        }
+        if (tokens[1].data[0] != '@') {
+            if (seconds > std::numeric_limits<std::time_t>::max() - now) {
+                error = "cannot move the clock past its end";
+                return false;
+            }
+            to = now + static_cast<std::time_t>(seconds);
+        }
+        if (home.virtualClock == nullptr) {
+            error = "advance needs a virtual clock (start with --clock)";
+            return false;
+        }
+        if (!advanceClock(home, to)) {
+            error = "cannot move the clock back to " + tokens[1].str();
+            return false;
+        }
+        return true;
+    }
+
+    if (command.is("simulate")) {
+        long long rooms, devicesPerRoom;
+        long long seed = 1;
+        SimulationPlan plan;
+        if (count < 5 || count > 6 || !parseInteger(tokens[1], rooms) || !parseInteger(tokens[2], devicesPerRoom)
+            || !parseNumber(tokens[3], plan.togglesPerDay) || !parseNumber(tokens[4], plan.days)
+            || (count == 6 && !parseInteger(tokens[5], seed))) {
+            error = "usage: simulate <rooms> <devices per room> <toggles per device per day> <days> [<seed>]";
+            return false;
+        }
+        const long long MAX_DEVICES = static_cast<long long>(SIMULATION_MAX_DEVICES);
+        if (rooms <= 0 || devicesPerRoom <= 0 || rooms > MAX_DEVICES || devicesPerRoom > MAX_DEVICES
+            || rooms * devicesPerRoom > MAX_DEVICES) {
+            error = "simulate takes 1 to ";
+            appendInteger(error, MAX_DEVICES);
+            error += " devices in all";
+            return false;
+        }
+        if (!(plan.togglesPerDay >= SIMULATION_MIN_TOGGLES_PER_DAY) || !(plan.togglesPerDay <= SIMULATION_MAX_TOGGLES_PER_DAY)) {
+            error = "toggles per day must be between ";
+            appendNumber(error, SIMULATION_MIN_TOGGLES_PER_DAY);
+            error += " and ";
+            appendNumber(error, SIMULATION_MAX_TOGGLES_PER_DAY);
+            return false;
+        }
+        if (!(plan.days > 0) || !(plan.days <= SIMULATION_MAX_DAYS)) {
+            error = "days must be above 0 and at most ";
+            appendNumber(error, SIMULATION_MAX_DAYS);
+            return false;
+        }
+        plan.rooms = static_cast<size_t>(rooms);
+        plan.devicesPerRoom = static_cast<size_t>(devicesPerRoom);
+        plan.seed = static_cast<std::uint64_t>(seed);
+        SimulationResult result;
+        if (!simulateHousehold(home, plan, result, error)) {
+            return false;
+        }
+        out += "simulated ";
+        appendInteger(out, static_cast<long long>(result.switches));
+        out += " switches of ";
+        appendInteger(out, static_cast<long long>(result.devices));
+        out += " devices, clock at ";
+        appendInteger(out, static_cast<long long>(home.now()));
+        out += '\n';
+        return true;
+    }
+
+    if (command.is("stats")) {
+        std::lock_guard<std::mutex> lock(home.mutex);
+        writeStats(home, format, out);
+        return true;
+    }
+
+    if (command.is("metrics")) {
+#if SMART_HOME_METRICS
+        if (count > 2 || format == FORMAT_CSV) {
+            error = "usage: metrics [<file>] [--json]";
+            return false;
+        }
+        if (count == 1) {
+            writeMetrics(format == FORMAT_JSON, out);
+            return true;
+        }
+        std::string dump;
+        writeMetrics(format == FORMAT_JSON, dump);
+        std::string path = tokens[1].str();
+        std::FILE* file = std::fopen(path.c_str(), "wb");
+        bool written = file && std::fwrite(dump.data(), 1, dump.size(), file) == dump.size();
+        if (file && std::fclose(file) != 0) {
+            written = false;
+        }
+        if (!written) {
+            error = "cannot write " + path;
+            return false;
+        }
+        return true;
+#else
+        error = "metrics are not included in this build";
+        return false;
+#endif
+    }
+
+    if (command.is("help")) {
+        out += BATCH_HELP;
+        return true;
+    }
+
+    if (command.is("quit")) {
+        quit = true;
+        return true;
+    }
+
+    error = "unknown command " + command.str();
+    return false;
+}
+
+size_t runBatch(Home& home, std::istream& in) {
+    const size_t OUTPUT_CHUNK = 1 << 16;
+    std::string line;
+    std::string out;
+    std::string error;
+    size_t lineNumber = 0;
+    size_t failures = 0;
+    bool quit = false;
+
+    // The journal is flushed once per output chunk and at the end instead of
+    // after every event
+    home.journal.autoFlush = false;
+    while (!quit && std::getline(in, line)) {
+        ++lineNumber;
+        if (!executeCommand(home, line, ORIGIN_LOCAL, out, error, quit)) {
+            ++failures;
+            std::fprintf(stderr, "line %zu: %s\n", lineNumber, error.c_str());
+        }
+        if (out.size() >= OUTPUT_CHUNK) {
+            std::fwrite(out.data(), 1, out.size(), stdout);
+            out.clear();
+            std::lock_guard<std::mutex> lock(home.mutex);
+            home.journal.flush();
+        }
+    }
+    std::fwrite(out.data(), 1, out.size(), stdout);
+    std::fflush(stdout);
+    std::lock_guard<std::mutex> lock(home.mutex);
+    home.journal.flush();
+    home.journal.autoFlush = true;
+    return failures;
+}
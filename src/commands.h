@@ -0,0 +1,33 @@
+//Project name : Smart Home Automation
+//file name : commands.h
+
+#ifndef SMART_HOME_COMMANDS_H
+#define SMART_HOME_COMMANDS_H
+
+#include <ctime>
+#include <istream>
+#include <string>
+
+#include "home.h"
+#include "report_writer.h"
+
+// Where a command line came from. Commands that read or write a file by
+// name (ingest, tariff <file>, metrics <file>) are refused from control
+// server clients, who could otherwise reach any file the server can.
+enum CommandOrigin {
+    ORIGIN_LOCAL,    // batch mode, run by the user who started the program
+    ORIGIN_REMOTE    // a control server client
+};
+
+// Execute one command line, appending any output to 'out'. Returns false with
+// a message in 'error' when the command is invalid or not allowed from
+// 'origin'. Sets 'quit' on "quit".
+bool executeCommand(Home& home, const std::string& line, CommandOrigin origin, std::string& out,
+                    std::string& error, bool& quit);
+
+// Run commands from 'in' until end of input or "quit". Output is buffered and
+// written in large chunks; errors go to stderr with their line number.
+// Returns the number of failed commands.
+size_t runBatch(Home& home, std::istream& in);
+
+#endif // SMART_HOME_COMMANDS_H
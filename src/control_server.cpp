@@ -0,0 +1,426 @@
+//Project name : Smart Home Automation
+//file name : control_server.cpp
+
+#include "control_server.h"
+
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#if defined(__linux__)
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#include "commands.h"
+#include "scheduler.h"
+
+// Blank and comment lines are skipped without a reply
+bool isCommandLine(const std::string& line) {
+    size_t start = line.find_first_not_of(" \t\r");
+    return start != std::string::npos && line[start] != '#';
+}
+
+// Run the newline-terminated commands in 'lines'. Each command's output is
+// followed by "ok" or "error: <reason>" so clients can pipeline requests.
+// Returns true if the client sent "quit".
+bool runCommands(Home& home, const std::string& lines, std::string& out) {
+    std::string line;
+    std::string error;
+    bool quit = false;
+    size_t start = 0;
+    while (!quit && start < lines.size()) {
+        size_t end = lines.find('\n', start);
+        if (end == std::string::npos) {
+            end = lines.size();
+        }
+        line.assign(lines, start, end - start);
+        start = end + 1;
+        if (!isCommandLine(line)) {
+            continue;
+        }
+        if (executeCommand(home, line, ORIGIN_REMOTE, out, error, quit)) {
+            out += "ok\n";
+        } else {
+            out += "error: ";
+            out += error;
+            out += '\n';
+        }
+    }
+    return quit;
+}
+
+#if defined(__linux__)
+
+volatile std::sig_atomic_t serverStopRequested = 0;
+int serverWakeFd = -1;
+
+void requestServerStop(int) {
+    serverStopRequested = 1;
+    std::uint64_t one = 1;
+    ssize_t written = write(serverWakeFd, &one, sizeof(one));
+    (void)written;
+}
+
+// One client. The buffers belong to the event loop thread; workers receive a
+// copy of the complete lines and hand their replies back through the loop.
+struct Connection {
+    int fd;
+    std::string input;
+    std::string output;
+    bool busy;          // a worker is running this client's commands
+    bool peerClosed;    // no more input will arrive
+    bool quit;          // close once the replies are written
+    bool wantWrite;     // EPOLLOUT is armed
+};
+
+// Single-threaded epoll event loop doing all socket I/O, with commands run on
+// a fixed worker pool. Each client has at most one batch in flight, so its
+// replies come back in request order.
+class ControlServer {
+public:
+    static const size_t MAX_LINE = 1 << 20;   // longest accepted request line
+
+    ControlServer(Home& h, size_t workers)
+        : home(h), pool(workers), epollFd(-1), listenFd(-1), wakeFd(-1) {}
+
+    ~ControlServer() {
+        pool.stop();
+        for (auto& entry : connections) {
+            ::close(entry.first);
+        }
+        if (listenFd >= 0) {
+            ::close(listenFd);
+        }
+        if (!unixPath.empty()) {
+            unlink(unixPath.c_str());
+        }
+        if (wakeFd >= 0) {
+            ::close(wakeFd);
+        }
+        if (epollFd >= 0) {
+            ::close(epollFd);
+        }
+    }
+
+    // Listen on "<port>" (127.0.0.1) or "unix:<path>"
+    bool listen(const std::string& address, std::string& error) {
+        if (address.compare(0, 5, "unix:") == 0) {
+            sockaddr_un addr;
+            std::memset(&addr, 0, sizeof(addr));
+            addr.sun_family = AF_UNIX;
+            std::string path = address.substr(5);
+            if (path.empty() || path.size() >= sizeof(addr.sun_path)) {
+                error = "invalid socket path";
+                return false;
+            }
+            std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+            unlink(path.c_str());
+            listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+            // Only the owner may connect; nobody can before listen() below
+            if (listenFd < 0 || bind(listenFd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0
+                || chmod(path.c_str(), S_IRUSR | S_IWUSR) < 0) {
+                error = std::strerror(errno);
+                return false;
+            }
+            unixPath = path;
+        } else {
+            char* end;
+            long port = std::strtol(address.c_str(), &end, 10);
+            if (address.empty() || *end != '\0' || port <= 0 || port > 65535) {
+                error = "invalid port " + address;
+                return false;
+            }
+            sockaddr_in addr;
+            std::memset(&addr, 0, sizeof(addr));
+            addr.sin_family = AF_INET;
+            addr.sin_port = htons(static_cast<std::uint16_t>(port));
+            addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            listenFd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+            int reuse = 1;
+            if (listenFd < 0 || setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse)) < 0
+                || bind(listenFd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) {
+                error = std::strerror(errno);
+                return false;
+            }
+        }
+        epollFd = epoll_create1(EPOLL_CLOEXEC);
+        wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (::listen(listenFd, SOMAXCONN) < 0 || epollFd < 0 || wakeFd < 0
+            || !watch(listenFd, EPOLLIN, EPOLL_CTL_ADD) || !watch(wakeFd, EPOLLIN, EPOLL_CTL_ADD)) {
+            error = std::strerror(errno);
+            return false;
+        }
+        return true;
+    }
+
+    // Serve until SIGINT or SIGTERM
+    void run() {
+        serverWakeFd = wakeFd;
+        std::signal(SIGINT, requestServerStop);
+        std::signal(SIGTERM, requestServerStop);
+        std::signal(SIGPIPE, SIG_IGN);
+        const int MAX_EVENTS = 128;
+        epoll_event events[MAX_EVENTS];
+        while (!serverStopRequested) {
+            int count = epoll_wait(epollFd, events, MAX_EVENTS, -1);
+            if (count < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                break;
+            }
+            for (int i = 0; i < count; ++i) {
+                int fd = events[i].data.fd;
+                if (fd == listenFd) {
+                    acceptClients();
+                } else if (fd == wakeFd) {
+                    std::uint64_t value;
+                    ssize_t drained = read(wakeFd, &value, sizeof(value));
+                    (void)drained;
+                    collectReplies();
+                } else {
+                    auto it = connections.find(fd);
+                    if (it == connections.end()) {
+                        continue;
+                    }
+                    std::shared_ptr<Connection> connection = it->second;
+                    if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+                        readClient(connection);
+                    }
+                    if (connection->fd >= 0 && (events[i].events & EPOLLOUT)) {
+                        writeClient(connection);
+                    }
+                }
+            }
+        }
+        std::signal(SIGINT, SIG_DFL);
+        std::signal(SIGTERM, SIG_DFL);
+        serverWakeFd = -1;
+    }
+
+private:
+    Home& home;
+    ThreadPool pool;
+    int epollFd;
+    int listenFd;
+    int wakeFd;
+    std::string unixPath;
+    std::unordered_map<int, std::shared_ptr<Connection> > connections;
+
+    // Replies finished by workers, waiting for the event loop
+    struct Reply {
+        std::shared_ptr<Connection> connection;
+        std::string output;
+        bool quit;
+    };
+    std::mutex repliesMutex;
+    std::vector<Reply> replies;
+
+    bool watch(int fd, std::uint32_t events, int op) {
+        epoll_event event;
+        std::memset(&event, 0, sizeof(event));
+        event.events = events;
+        event.data.fd = fd;
+        return epoll_ctl(epollFd, op, fd, &event) == 0;
+    }
+
+    void acceptClients() {
+        for (;;) {
+            int fd = accept4(listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (fd < 0) {
+                return;
+            }
+            int noDelay = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+            std::shared_ptr<Connection> connection = std::make_shared<Connection>();
+            connection->fd = fd;
+            connection->busy = false;
+            connection->peerClosed = false;
+            connection->quit = false;
+            connection->wantWrite = false;
+            if (!watch(fd, EPOLLIN | EPOLLRDHUP, EPOLL_CTL_ADD)) {
+                ::close(fd);
+                continue;
+            }
+            connections[fd] = connection;
+        }
+    }
+
+    void closeClient(const std::shared_ptr<Connection>& connection) {
+        if (connection->fd < 0) {
+            return;
+        }
+        epoll_ctl(epollFd, EPOLL_CTL_DEL, connection->fd, nullptr);
+        ::close(connection->fd);
+        connections.erase(connection->fd);
+        connection->fd = -1;
+    }
+
+    void readClient(const std::shared_ptr<Connection>& connection) {
+        char buffer[1 << 16];
+        for (;;) {
+            ssize_t received = read(connection->fd, buffer, sizeof(buffer));
+            if (received > 0) {
+                connection->input.append(buffer, static_cast<size_t>(received));
+                continue;
+            }
+            if (received == 0) {
+                connection->peerClosed = true;
+                break;
+            }
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                closeClient(connection);
+                return;
+            }
+            break;
+        }
+        if (connection->peerClosed) {
+            // Stop polling for input; the pending replies still go out
+            watch(connection->fd, connection->wantWrite ? std::uint32_t(EPOLLOUT) : 0u, EPOLL_CTL_MOD);
+        }
+        dispatch(connection);
+    }
+
+    // Hand the complete lines received so far to a worker
+    void dispatch(const std::shared_ptr<Connection>& connection) {
+        if (connection->busy || connection->quit) {
+            finishIfDone(connection);
+            return;
+        }
+        size_t last = connection->input.rfind('\n');
+        if (last == std::string::npos) {
+            if (connection->input.size() > MAX_LINE) {
+                closeClient(connection);
+                return;
+            }
+            if (!connection->peerClosed || connection->input.empty()) {
+                finishIfDone(connection);
+                return;
+            }
+            last = connection->input.size() - 1;   // unterminated final line
+        }
+        std::string lines(connection->input, 0, last + 1);
+        connection->input.erase(0, last + 1);
+        connection->busy = true;
+        Home* target = &home;
+        ControlServer* server = this;
+        std::shared_ptr<Connection> client = connection;
+        pool.submit([target, server, client, lines]() {
+            Reply reply;
+            reply.connection = client;
+            reply.quit = runCommands(*target, lines, reply.output);
+            server->postReply(reply);
+        });
+    }
+
+    // Called on a worker thread
+    void postReply(Reply& reply) {
+        {
+            std::lock_guard<std::mutex> lock(repliesMutex);
+            replies.push_back(Reply());
+            replies.back().connection.swap(reply.connection);
+            replies.back().output.swap(reply.output);
+            replies.back().quit = reply.quit;
+        }
+        std::uint64_t one = 1;
+        ssize_t written = write(wakeFd, &one, sizeof(one));
+        (void)written;
+    }
+
+    void collectReplies() {
+        std::vector<Reply> ready;
+        {
+            std::lock_guard<std::mutex> lock(repliesMutex);
+            ready.swap(replies);
+        }
+        for (auto& reply : ready) {
+            const std::shared_ptr<Connection>& connection = reply.connection;
+            connection->busy = false;
+            if (connection->fd < 0) {
+                continue;
+            }
+            connection->output += reply.output;
+            connection->quit = connection->quit || reply.quit;
+            writeClient(connection);
+            if (connection->fd >= 0) {
+                dispatch(connection);
+            }
+        }
+    }
+
+    void writeClient(const std::shared_ptr<Connection>& connection) {
+        size_t sent = 0;
+        std::string& output = connection->output;
+        while (sent < output.size()) {
+            ssize_t written = send(connection->fd, output.data() + sent, output.size() - sent, MSG_NOSIGNAL);
+            if (written > 0) {
+                sent += static_cast<size_t>(written);
+            } else if (written < 0 && errno == EINTR) {
+                continue;
+            } else if (written < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                break;
+            } else {
+                closeClient(connection);
+                return;
+            }
+        }
+        output.erase(0, sent);
+        bool wantWrite = !output.empty();
+        if (wantWrite != connection->wantWrite) {
+            connection->wantWrite = wantWrite;
+            std::uint32_t events = (connection->peerClosed ? 0u : std::uint32_t(EPOLLIN | EPOLLRDHUP))
+                | (wantWrite ? std::uint32_t(EPOLLOUT) : 0u);
+            watch(connection->fd, events, EPOLL_CTL_MOD);
+        }
+        finishIfDone(connection);
+    }
+
+    // Close once nothing is running or waiting to be written
+    void finishIfDone(const std::shared_ptr<Connection>& connection) {
+        if (connection->fd < 0 || connection->busy || !connection->output.empty()) {
+            return;
+        }
+        if (connection->quit || (connection->peerClosed && connection->input.empty())) {
+            closeClient(connection);
+        }
+    }
+};
+
+const size_t ControlServer::MAX_LINE;
+
+bool runServer(Home& home, const std::string& address, size_t workers) {
+    ControlServer server(home, workers);
+    std::string error;
+    if (!server.listen(address, error)) {
+        std::cerr << "Cannot listen on " << address << ": " << error << "\n";
+        return false;
+    }
+    std::cout << "Listening on " << address << " with " << workers << " workers. Press Ctrl+C to stop.\n"
+              << std::flush;
+    server.run();
+    return true;
+}
+
+#else
+
+bool runServer(Home&, const std::string&, size_t) {
+    std::cerr << "The control server is only available on Linux.\n";
+    return false;
+}
+
+#endif
@@ -0,0 +1,16 @@
+//Project name : Smart Home Automation
+//file name : control_server.h
+
+#ifndef SMART_HOME_CONTROL_SERVER_H
+#define SMART_HOME_CONTROL_SERVER_H
+
+#include <cstddef>
+#include <string>
+
+#include "home.h"
+
+// Serve the batch commands until interrupted. Returns false if the address
+// cannot be used.
+bool runServer(Home& home, const std::string& address, size_t workers);
+
+#endif // SMART_HOME_CONTROL_SERVER_H
@@ -0,0 +1,52 @@
+//Project name : Smart Home Automation
+//file name : device_registry.cpp
+
+#include "device_registry.h"
+
+#include <cstring>
+
+const std::uint32_t RecordArena::BLOCK_BYTES;
+const std::uint32_t RecordArena::MAX_BLOCK_RECORDS;
+const std::uint32_t RecordArena::BLOCKS_PER_CHUNK;
+const std::uint32_t RecordArena::NO_BLOCK;
+
+const std::uint32_t DeviceRegistry::NO_BLOCK;
+
+namespace {
+
+// Longest varint of a 64-bit value
+const size_t MAX_VARINT_BYTES = 10;
+
+// Write 'value' zigzag-encoded as a little-endian base-128 varint, so small
+// negative gaps (records added out of order) stay short too
+size_t putZigzag(std::uint8_t* out, std::int64_t value) {
+    std::uint64_t bits = (static_cast<std::uint64_t>(value) << 1) ^ static_cast<std::uint64_t>(value >> 63);
+    size_t size = 0;
+    while (bits >= 0x80) {
+        out[size++] = static_cast<std::uint8_t>(bits | 0x80);
+        bits >>= 7;
+    }
+    out[size++] = static_cast<std::uint8_t>(bits);
+    return size;
+}
+
+} // namespace
+
+bool RecordArena::Block::append(const ActivationRecord& record) {
+    std::int64_t onTime = record.onTime;
+    std::int64_t offTime = record.offTime;
+    std::uint8_t encoded[2 * MAX_VARINT_BYTES];
+    size_t size = putZigzag(encoded, onTime - previousOffTime);
+    size += putZigzag(encoded + size, offTime - onTime);
+    if (used + size > BLOCK_BYTES) {
+        return false;
+    }
+    std::memcpy(bytes + used, encoded, size);
+    used = static_cast<std::uint16_t>(used + size);
+    ++count;
+    previousOffTime = offTime;
+    spanBegin = std::min(spanBegin, onTime);
+    spanEnd = std::max(spanEnd, offTime);
+    seconds += std::max<std::int64_t>(offTime - onTime, 0);
+    return true;
+}
@@ -0,0 +1,523 @@
+//Project name : Smart Home Automation
+//file name : device_registry.h
+
+#ifndef SMART_HOME_DEVICE_REGISTRY_H
+#define SMART_HOME_DEVICE_REGISTRY_H
+
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <cstdint>
+#include <ctime>
+#include <memory>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "clock.h"
+
+// Activation record for devices
+struct ActivationRecord {
+    std::time_t onTime;
+    std::time_t offTime;
+};
+
+// One closed activation record moved out of memory into the history files
+struct HistoryRow {
+    std::int64_t onTime;
+    std::int64_t offTime;
+    std::uint32_t deviceId;
+};
+
+// Interned names; every distinct name is stored once and referred to by id
+class NameTable {
+public:
+    std::uint32_t intern(const std::string& name) {
+        auto it = ids.find(name);
+        if (it != ids.end()) {
+            return it->second;
+        }
+        std::uint32_t id = static_cast<std::uint32_t>(names.size());
+        names.push_back(name);
+        ids.emplace(name, id);
+        return id;
+    }
+
+    const std::string& lookup(std::uint32_t id) const { return names[id]; }
+
+    bool find(const std::string& name, std::uint32_t& id) const {
+        auto it = ids.find(name);
+        if (it == ids.end()) {
+            return false;
+        }
+        id = it->second;
+        return true;
+    }
+
+private:
+    std::vector<std::string> names;
+    std::unordered_map<std::string, std::uint32_t> ids;
+};
+
+// Append-only list that lock-free readers can use while one writer appends.
+// Elements live in chunks that never move (chunk k holds BASE << k of them),
+// and readers only look below the published size. Appends are serialized by
+// the caller.
+template <typename T>
+class PublishedList {
+public:
+    PublishedList() : count(0) {
+        for (auto& chunk : chunks) {
+            chunk.store(nullptr, std::memory_order_relaxed);
+        }
+    }
+
+    ~PublishedList() {
+        for (auto& chunk : chunks) {
+            delete[] chunk.load(std::memory_order_relaxed);
+        }
+    }
+
+    PublishedList(const PublishedList&) = delete;
+    PublishedList& operator=(const PublishedList&) = delete;
+
+    // Number of published elements
+    size_t size() const { return count.load(std::memory_order_acquire); }
+
+    const T& operator[](size_t index) const { return slot(index); }
+    T& operator[](size_t index) { return slot(index); }
+
+    // The element after the last published one, allocated on demand; fill it
+    // in, then commit() to make it visible
+    T& next() {
+        size_t index = count.load(std::memory_order_relaxed);
+        size_t chunk, offset;
+        locate(index, chunk, offset);
+        if (offset == 0 && !chunks[chunk].load(std::memory_order_relaxed)) {
+            chunks[chunk].store(new T[BASE << chunk](), std::memory_order_release);
+        }
+        return chunks[chunk].load(std::memory_order_relaxed)[offset];
+    }
+
+    void commit() {
+        count.store(count.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    void push_back(const T& value) {
+        next() = value;
+        commit();
+    }
+
+private:
+    static const size_t BASE = 16;
+    static const size_t MAX_CHUNKS = 32;
+
+    std::atomic<T*> chunks[MAX_CHUNKS];
+    std::atomic<size_t> count;
+
+    static void locate(size_t index, size_t& chunk, size_t& offset) {
+        size_t bucket = index / BASE + 1;
+        chunk = 0;
+        while (bucket >> (chunk + 1)) {
+            ++chunk;
+        }
+        offset = index - BASE * ((size_t(1) << chunk) - 1);
+    }
+
+    T& slot(size_t index) const {
+        size_t chunk, offset;
+        locate(index, chunk, offset);
+        return chunks[chunk].load(std::memory_order_acquire)[offset];
+    }
+};
+
+template <typename T>
+const size_t PublishedList<T>::BASE;
+
+// Device status bits readable without a lock. Writers are serialized by the
+// caller and bump 'version' around each change, seqlock-style, so a reader
+// can copy every bit as of a single moment.
+class StatusBits {
+public:
+    StatusBits() : version(0) {}
+
+    void grow(size_t bits) {
+        while (words.size() * 64 < bits) {
+            words.next().store(0, std::memory_order_relaxed);
+            words.commit();
+        }
+    }
+
+    bool get(size_t id) const {
+        return (words[id / 64].load(std::memory_order_acquire) >> (id % 64)) & 1u;
+    }
+
+    void set(size_t id, bool on) {
+        std::uint64_t mask = std::uint64_t(1) << (id % 64);
+        std::uint64_t start = version.load(std::memory_order_relaxed);
+        version.store(start + 1, std::memory_order_relaxed);   // odd: change in progress
+        std::atomic_thread_fence(std::memory_order_release);
+        if (on) {
+            words[id / 64].fetch_or(mask, std::memory_order_relaxed);
+        } else {
+            words[id / 64].fetch_and(~mask, std::memory_order_relaxed);
+        }
+        version.store(start + 2, std::memory_order_release);
+    }
+
+    // Copy every word, retrying if a change happened meanwhile
+    void snapshot(std::vector<std::uint64_t>& out) const {
+        for (;;) {
+            std::uint64_t before = version.load(std::memory_order_acquire);
+            if (before & 1) {
+                std::this_thread::yield();
+                continue;
+            }
+            out.resize(words.size());
+            for (size_t i = 0; i < out.size(); ++i) {
+                out[i] = words[i].load(std::memory_order_relaxed);
+            }
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (version.load(std::memory_order_relaxed) == before) {
+                return;
+            }
+        }
+    }
+
+private:
+    PublishedList<std::atomic<std::uint64_t> > words;
+    std::atomic<std::uint64_t> version;
+};
+
+// Chunked arena of fixed-size blocks of closed activation records. Each
+// record is packed as two zigzag varints, the gap from the previous record's
+// OFF time (the block's epoch for the first one) and the duration, so a
+// device switched every few minutes takes 3-5 bytes per record instead of
+// 16. Every block also keeps the span and the total seconds of its records,
+// letting range sums take whole blocks without decoding them. Chunks never
+// move, and clear() keeps them for reuse instead of returning them to the
+// heap.
+class RecordArena {
+public:
+    static const std::uint32_t BLOCK_BYTES = 208;        // encoded records per block
+    static const std::uint32_t MAX_BLOCK_RECORDS = BLOCK_BYTES / 2;
+    static const std::uint32_t BLOCKS_PER_CHUNK = 256;
+    static const std::uint32_t NO_BLOCK = UINT32_MAX;
+
+    struct Block {
+        std::int64_t epoch;                  // base of the first record's gap
+        std::int64_t previousOffTime;        // base of the next record's gap
+        std::int64_t spanBegin;              // earliest ON time in the block
+        std::int64_t spanEnd;                // latest OFF time in the block
+        std::int64_t seconds;                // total duration of the records
+        std::uint32_t next;                  // next block of the same device
+        std::uint16_t count;
+        std::uint16_t used;                  // bytes taken in 'bytes'
+        std::uint8_t bytes[BLOCK_BYTES];
+
+        // Encode 'record' after the others; false when the block is full
+        bool append(const ActivationRecord& record);
+
+        // Call fn(record) for each record in the order they were added
+        template <typename Fn>
+        void forEach(Fn fn) const {
+            const std::uint8_t* in = bytes;
+            std::int64_t offTime = epoch;
+            for (std::uint32_t i = 0; i < count; ++i) {
+                ActivationRecord record;
+                std::int64_t onTime = offTime + readZigzag(in);
+                offTime = onTime + readZigzag(in);
+                record.onTime = static_cast<std::time_t>(onTime);
+                record.offTime = static_cast<std::time_t>(offTime);
+                fn(record);
+            }
+        }
+
+        // Decode every record into 'out', which holds MAX_BLOCK_RECORDS;
+        // returns the count
+        std::uint32_t decode(ActivationRecord* out) const {
+            forEach([&](const ActivationRecord& record) { *out++ = record; });
+            return count;
+        }
+    };
+
+    RecordArena() : usedBlocks(0) {}
+
+    // Index of a fresh, empty block with no successor whose first gap is
+    // measured from 'epoch'
+    std::uint32_t allocate(std::int64_t epoch) {
+        if (usedBlocks == chunks.size() * BLOCKS_PER_CHUNK) {
+            chunks.push_back(std::unique_ptr<Block[]>(new Block[BLOCKS_PER_CHUNK]));
+        }
+        std::uint32_t index = usedBlocks++;
+        Block& fresh = block(index);
+        fresh.epoch = epoch;
+        fresh.previousOffTime = epoch;
+        fresh.spanBegin = INT64_MAX;
+        fresh.spanEnd = INT64_MIN;
+        fresh.seconds = 0;
+        fresh.next = NO_BLOCK;
+        fresh.count = 0;
+        fresh.used = 0;
+        return index;
+    }
+
+    Block& block(std::uint32_t index) { return chunks[index / BLOCKS_PER_CHUNK][index % BLOCKS_PER_CHUNK]; }
+    const Block& block(std::uint32_t index) const { return chunks[index / BLOCKS_PER_CHUNK][index % BLOCKS_PER_CHUNK]; }
+
+    // Release every block; the chunks stay allocated
+    void clear() { usedBlocks = 0; }
+
+    size_t blocksInUse() const { return usedBlocks; }
+    size_t chunkCount() const { return chunks.size(); }
+
+private:
+    std::vector<std::unique_ptr<Block[]> > chunks;
+    std::uint32_t usedBlocks;
+
+    static std::int64_t readZigzag(const std::uint8_t*& in) {
+        std::uint64_t value = 0;
+        for (int shift = 0; ; shift += 7) {
+            std::uint8_t byte = *in++;
+            value |= static_cast<std::uint64_t>(byte & 0x7f) << shift;
+            if (!(byte & 0x80)) {
+                break;
+            }
+        }
+        return static_cast<std::int64_t>(value >> 1) ^ -static_cast<std::int64_t>(value & 1);
+    }
+};
+
+// Device registry: every device of the home stored as parallel arrays indexed
+// by device id, so sweeps over power ratings and status bits stay contiguous.
+class DeviceRegistry {
+public:
+    static const std::uint32_t NO_BLOCK = RecordArena::NO_BLOCK;
+
+    // Hot columns
+    std::vector<double> powerRatings;
+    StatusBits statusBits;                         // one bit per device, lock-free reads
+    std::vector<std::uint32_t> roomIds;
+    std::vector<double> closedActiveSeconds;       // running total of closed records
+    std::vector<std::time_t> openOnTimes;          // ON time of the open record, 0 if none
+    std::vector<double> meteredEnergy;             // kWh from power samples, negative before the first
+    // Cold columns
+    std::vector<std::uint32_t> nameIds;
+    std::vector<std::uint32_t> firstBlocks;        // closed record blocks in the arena
+    std::vector<std::uint32_t> lastBlocks;
+    std::vector<std::uint32_t> recordCounts;       // closed records, plus one if open
+    const Clock* clock;                            // "now" for callers that do not pass a time
+
+    DeviceRegistry() : clock(&systemClock()), storedRecords(0) {}
+
+    size_t size() const { return powerRatings.size(); }
+
+    // Number of records (open and closed) currently held in memory
+    size_t recordsInMemory() const { return storedRecords; }
+
+    const RecordArena& recordArena() const { return arena; }
+
+    size_t addDevice(std::uint32_t roomId, const std::string& name, double powerRating) {
+        size_t id = size();
+        statusBits.grow(id + 1);
+        powerRatings.push_back(powerRating);
+        roomIds.push_back(roomId);
+        closedActiveSeconds.push_back(0.0);
+        openOnTimes.push_back(0);
+        meteredEnergy.push_back(-1.0);
+        nameIds.push_back(names.intern(name));
+        firstBlocks.push_back(NO_BLOCK);
+        lastBlocks.push_back(NO_BLOCK);
+        recordCounts.push_back(0);
+        return id;
+    }
+
+    const std::string& name(size_t id) const { return names.lookup(nameIds[id]); }
+
+    // Interned id of a name, if any device has ever used it
+    bool findName(const std::string& name, std::uint32_t& nameId) const { return names.find(name, nameId); }
+
+    bool status(size_t id) const { return statusBits.get(id); }
+
+    void setStatus(size_t id, bool on) { statusBits.set(id, on); }
+
+    bool hasOpenRecord(size_t id) const { return openOnTimes[id] != 0; }
+
+    // Open a new record at the given time
+    void openRecord(size_t id, std::time_t onTime) {
+        if (!hasOpenRecord(id)) {
+            ++recordCounts[id];
+            ++storedRecords;
+        }
+        openOnTimes[id] = onTime;
+    }
+
+    // Close the open record and fold it into the running total
+    void closeRecord(size_t id, std::time_t offTime) {
+        if (!hasOpenRecord(id)) {
+            return;
+        }
+        ActivationRecord record;
+        record.onTime = openOnTimes[id];
+        record.offTime = offTime;
+        appendClosedRecord(id, record);
+        closedActiveSeconds[id] += difftime(record.offTime, record.onTime);
+        openOnTimes[id] = 0;
+    }
+
+    // Append an already closed record (e.g. a timer schedule)
+    void addClosedRecord(size_t id, const ActivationRecord& record) {
+        appendClosedRecord(id, record);
+        ++recordCounts[id];
+        ++storedRecords;
+        closedActiveSeconds[id] += difftime(record.offTime, record.onTime);
+    }
+
+    // Total activation time in seconds, evaluating an open record up to 'now'
+    double totalActiveTime(size_t id, std::time_t now) const {
+        double totalTime = closedActiveSeconds[id];
+        if (openOnTimes[id] != 0) {
+            totalTime += difftime(now, openOnTimes[id]);
+        }
+        return totalTime;
+    }
+
+    // Whether power samples have been recorded for the device
+    bool isMetered(size_t id) const { return meteredEnergy[id] >= 0.0; }
+
+    // Energy consumed in kWh: the metered energy once the device has power
+    // samples, otherwise its power rating over the activation time up to 'now'
+    double energyConsumed(size_t id, std::time_t now) const {
+        if (isMetered(id)) {
+            return meteredEnergy[id];
+        }
+        return (powerRatings[id] / 1000.0) * (totalActiveTime(id, now) / 3600.0);
+    }
+
+    // Visit the blocks holding the closed records of one device, in the
+    // order they were added, as fn(block)
+    template <typename Fn>
+    void forEachClosedBlock(size_t id, Fn fn) const {
+        for (std::uint32_t block = firstBlocks[id]; block != NO_BLOCK; block = arena.block(block).next) {
+            fn(arena.block(block));
+        }
+    }
+
+    // Visit the records of one device: the closed ones in the order they
+    // were added, then the open one (offTime 0), if any
+    template <typename Fn>
+    void forEachRecord(size_t id, Fn fn) const {
+        forEachClosedBlock(id, [&](const RecordArena::Block& block) {
+            block.forEach(fn);
+        });
+        if (hasOpenRecord(id)) {
+            ActivationRecord openRecord;
+            openRecord.onTime = openOnTimes[id];
+            openRecord.offTime = 0;
+            fn(openRecord);
+        }
+    }
+
+    // Copy every closed record held in memory into 'out'
+    void collectClosedRecords(std::vector<HistoryRow>& out) const {
+        for (size_t id = 0; id < size(); ++id) {
+            forEachClosedBlock(id, [&](const RecordArena::Block& block) {
+                block.forEach([&](const ActivationRecord& record) {
+                    HistoryRow row;
+                    row.onTime = record.onTime;
+                    row.offTime = record.offTime;
+                    row.deviceId = static_cast<std::uint32_t>(id);
+                    out.push_back(row);
+                });
+            });
+        }
+    }
+
+    // Release every closed record, keeping only the open ones; running totals
+    // are unaffected
+    void dropClosedRecords() {
+        arena.clear();
+        storedRecords = 0;
+        for (size_t id = 0; id < size(); ++id) {
+            firstBlocks[id] = NO_BLOCK;
+            lastBlocks[id] = NO_BLOCK;
+            recordCounts[id] = hasOpenRecord(id) ? 1 : 0;
+            storedRecords += recordCounts[id];
+        }
+    }
+
+private:
+    NameTable names;
+    // Closed records live in encoded blocks; each device owns a chain of
+    // blocks. Open records are only kept in openOnTimes.
+    RecordArena arena;
+    size_t storedRecords;
+
+    void appendClosedRecord(size_t id, const ActivationRecord& record) {
+        if (lastBlocks[id] != NO_BLOCK && arena.block(lastBlocks[id]).append(record)) {
+            return;
+        }
+        std::uint32_t block = arena.allocate(record.onTime);
+        if (lastBlocks[id] == NO_BLOCK) {
+            firstBlocks[id] = block;
+        } else {
+            arena.block(lastBlocks[id]).next = block;
+        }
+        lastBlocks[id] = block;
+        arena.block(block).append(record);
+    }
+};
+
+// Device class: a view onto one entry of the registry
+class Device {
+public:
+    Device(DeviceRegistry& r, size_t id) : registry(&r), deviceId(id) {}
+
+    size_t id() const { return deviceId; }
+    const std::string& name() const { return registry->name(deviceId); }
+    double powerRating() const { return registry->powerRatings[deviceId]; }
+    bool status() const { return registry->status(deviceId); }
+    void setStatus(bool on) { registry->setStatus(deviceId, on); }
+
+    bool hasOpenRecord() const { return registry->hasOpenRecord(deviceId); }
+    void openRecord(std::time_t onTime) { registry->openRecord(deviceId, onTime); }
+    void closeRecord(std::time_t offTime) { registry->closeRecord(deviceId, offTime); }
+    void addClosedRecord(const ActivationRecord& record) { registry->addClosedRecord(deviceId, record); }
+
+    // Calculate energy consumed by this device up to the registry's clock
+    double calculateEnergyConsumed() const {
+        return calculateEnergyConsumed(registry->clock->now());
+    }
+
+    // Calculate energy consumed, from the power samples if the device is
+    // metered, else evaluating an open record up to 'now'
+    double calculateEnergyConsumed(std::time_t now) const {
+        return registry->energyConsumed(deviceId, now);
+    }
+
+    // Calculate total activation time up to the registry's clock
+    double totalActiveTime() const {
+        return totalActiveTime(registry->clock->now());
+    }
+
+    // Calculate total activation time, evaluating an open record up to 'now'
+    double totalActiveTime(std::time_t now) const {
+        return registry->totalActiveTime(deviceId, now); // in seconds
+    }
+
+private:
+    DeviceRegistry* registry;
+    size_t deviceId;
+};
+
+// Room class
+class Room {
+public:
+    std::string name;
+    std::vector<Device> devices;
+
+    explicit Room(std::string n) : name(std::move(n)) {}
+};
+
+#endif // SMART_HOME_DEVICE_REGISTRY_H
@@ -0,0 +1,232 @@
+//Project name : Smart Home Automation
+//file name : energy_kernel.cpp
+
+#include "energy_kernel.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define SMART_HOME_HAVE_AVX2 1
+#include <immintrin.h>
+#else
+#define SMART_HOME_HAVE_AVX2 0
+#endif
+
+namespace {
+
+// Rows handled per pass of accumulateClippedSeconds; the clipped durations
+// of one pass stay in L1 until they are scattered to the devices
+const size_t ROW_BATCH = 256;
+
+void deviceTotalsScalar(const double* closedSeconds, const std::time_t* openOnTimes, const double* powerRatings,
+                        size_t n, std::time_t now, double* activeSeconds, double* energy) {
+    for (size_t i = 0; i < n; ++i) {
+        double seconds = closedSeconds[i];
+        if (openOnTimes[i] != 0) {
+            seconds += static_cast<double>(now - openOnTimes[i]);
+        }
+        activeSeconds[i] = seconds;
+        energy[i] = (powerRatings[i] / 1000.0) * (seconds / 3600.0);
+    }
+}
+
+std::int64_t clippedSecondsScalar(const ActivationRecord* records, size_t n,
+                                  std::time_t from, std::time_t to, std::time_t now) {
+    std::int64_t total = 0;
+    for (size_t i = 0; i < n; ++i) {
+        std::time_t start = std::max(records[i].onTime, from);
+        std::time_t end = std::min(records[i].offTime == 0 ? now : records[i].offTime, to);
+        if (end > start) {
+            total += static_cast<std::int64_t>(end - start);
+        }
+    }
+    return total;
+}
+
+void clippedRowsScalar(const std::int64_t* onTimes, const std::int64_t* offTimes, size_t n,
+                       std::int64_t from, std::int64_t to, std::int64_t* out) {
+    for (size_t i = 0; i < n; ++i) {
+        std::int64_t start = std::max(onTimes[i], from);
+        std::int64_t end = std::min(offTimes[i], to);
+        out[i] = end > start ? end - start : 0;
+    }
+}
+
+#if SMART_HOME_HAVE_AVX2
+
+// The AVX2 kernels read time_t and ActivationRecord as 64-bit lanes
+const bool AVX2_LAYOUT_OK = sizeof(std::time_t) == 8 && sizeof(ActivationRecord) == 16 &&
+                            offsetof(ActivationRecord, offTime) == 8;
+
+#define SMART_HOME_AVX2 __attribute__((target("avx2")))
+
+SMART_HOME_AVX2 inline __m256i min64(__m256i a, __m256i b) {
+    return _mm256_blendv_epi8(a, b, _mm256_cmpgt_epi64(a, b));
+}
+
+SMART_HOME_AVX2 inline __m256i max64(__m256i a, __m256i b) {
+    return _mm256_blendv_epi8(b, a, _mm256_cmpgt_epi64(a, b));
+}
+
+// Exact int64 -> double for |x| < 2^51 (AVX2 has no such conversion)
+SMART_HOME_AVX2 inline __m256d toDouble(__m256i x) {
+    const __m256d magic = _mm256_set1_pd(6755399441055744.0); // 2^52 + 2^51
+    return _mm256_sub_pd(_mm256_castsi256_pd(_mm256_add_epi64(x, _mm256_castpd_si256(magic))), magic);
+}
+
+SMART_HOME_AVX2 void deviceTotalsAvx2(const double* closedSeconds, const std::time_t* openOnTimes,
+                                      const double* powerRatings, size_t n, std::time_t now,
+                                      double* activeSeconds, double* energy) {
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i nowV = _mm256_set1_epi64x(static_cast<long long>(now));
+    const __m256d kilo = _mm256_set1_pd(1000.0);
+    const __m256d hour = _mm256_set1_pd(3600.0);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256i onTime = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(openOnTimes + i));
+        __m256i open = _mm256_sub_epi64(nowV, onTime);
+        open = _mm256_andnot_si256(_mm256_cmpeq_epi64(onTime, zero), open);
+        __m256d seconds = _mm256_add_pd(_mm256_loadu_pd(closedSeconds + i), toDouble(open));
+        __m256d power = _mm256_div_pd(_mm256_loadu_pd(powerRatings + i), kilo);
+        _mm256_storeu_pd(activeSeconds + i, seconds);
+        _mm256_storeu_pd(energy + i, _mm256_mul_pd(power, _mm256_div_pd(seconds, hour)));
+    }
+    deviceTotalsScalar(closedSeconds + i, openOnTimes + i, powerRatings + i, n - i, now, activeSeconds + i, energy + i);
+}
+
+// Clipped duration of four intervals, 0 where they miss [from, to)
+SMART_HOME_AVX2 inline __m256i clip(__m256i onTime, __m256i offTime, __m256i from, __m256i to) {
+    __m256i duration = _mm256_sub_epi64(min64(offTime, to), max64(onTime, from));
+    return _mm256_and_si256(duration, _mm256_cmpgt_epi64(duration, _mm256_setzero_si256()));
+}
+
+SMART_HOME_AVX2 std::int64_t clippedSecondsAvx2(const ActivationRecord* records, size_t n,
+                                                std::time_t from, std::time_t to, std::time_t now) {
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i fromV = _mm256_set1_epi64x(static_cast<long long>(from));
+    const __m256i toV = _mm256_set1_epi64x(static_cast<long long>(to));
+    const __m256i nowV = _mm256_set1_epi64x(static_cast<long long>(now));
+    __m256i sum = zero;
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        // Two loads hold {on, off} of four records; unpacking gives the
+        // on and off lanes in the order 0, 2, 1, 3
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(records + i));
+        __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(records + i + 2));
+        __m256i onTime = _mm256_unpacklo_epi64(a, b);
+        __m256i offTime = _mm256_unpackhi_epi64(a, b);
+        offTime = _mm256_blendv_epi8(offTime, nowV, _mm256_cmpeq_epi64(offTime, zero));
+        sum = _mm256_add_epi64(sum, clip(onTime, offTime, fromV, toV));
+    }
+    std::int64_t lanes[4];
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(lanes), sum);
+    return lanes[0] + lanes[1] + lanes[2] + lanes[3] + clippedSecondsScalar(records + i, n - i, from, to, now);
+}
+
+SMART_HOME_AVX2 void clippedRowsAvx2(const std::int64_t* onTimes, const std::int64_t* offTimes, size_t n,
+                                     std::int64_t from, std::int64_t to, std::int64_t* out) {
+    const __m256i fromV = _mm256_set1_epi64x(static_cast<long long>(from));
+    const __m256i toV = _mm256_set1_epi64x(static_cast<long long>(to));
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256i onTime = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(onTimes + i));
+        __m256i offTime = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(offTimes + i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), clip(onTime, offTime, fromV, toV));
+    }
+    clippedRowsScalar(onTimes + i, offTimes + i, n - i, from, to, out + i);
+}
+
+bool cpuHasAvx2() {
+    return AVX2_LAYOUT_OK && __builtin_cpu_supports("avx2");
+}
+
+#else
+
+bool cpuHasAvx2() {
+    return false;
+}
+
+#endif
+
+EnergyKernel detectKernel() {
+    const char* setting = std::getenv("SMART_HOME_KERNEL");
+    if (setting != nullptr && std::strcmp(setting, "scalar") == 0) {
+        return KERNEL_SCALAR;
+    }
+    return cpuHasAvx2() ? KERNEL_AVX2 : KERNEL_SCALAR;
+}
+
+std::atomic<int>& selectedKernel() {
+    static std::atomic<int> kernel(detectKernel());
+    return kernel;
+}
+
+bool useAvx2() {
+    return selectedKernel().load(std::memory_order_relaxed) == KERNEL_AVX2;
+}
+
+} // namespace
+
+EnergyKernel activeEnergyKernel() {
+    return static_cast<EnergyKernel>(selectedKernel().load(std::memory_order_relaxed));
+}
+
+EnergyKernel forceEnergyKernel(EnergyKernel kernel) {
+    if (kernel == KERNEL_AVX2 && !cpuHasAvx2()) {
+        kernel = KERNEL_SCALAR;
+    }
+    selectedKernel().store(kernel, std::memory_order_relaxed);
+    return kernel;
+}
+
+const char* energyKernelName(EnergyKernel kernel) {
+    return kernel == KERNEL_AVX2 ? "avx2" : "scalar";
+}
+
+void deviceTotals(const double* closedSeconds, const std::time_t* openOnTimes, const double* powerRatings,
+                  size_t n, std::time_t now, double* activeSeconds, double* energy) {
+#if SMART_HOME_HAVE_AVX2
+    if (useAvx2()) {
+        deviceTotalsAvx2(closedSeconds, openOnTimes, powerRatings, n, now, activeSeconds, energy);
+        return;
+    }
+#endif
+    deviceTotalsScalar(closedSeconds, openOnTimes, powerRatings, n, now, activeSeconds, energy);
+}
+
+std::int64_t clippedSeconds(const ActivationRecord* records, size_t n,
+                            std::time_t from, std::time_t to, std::time_t now) {
+#if SMART_HOME_HAVE_AVX2
+    if (useAvx2()) {
+        return clippedSecondsAvx2(records, n, from, to, now);
+    }
+#endif
+    return clippedSecondsScalar(records, n, from, to, now);
+}
+
+void accumulateClippedSeconds(const std::int64_t* onTimes, const std::int64_t* offTimes,
+                              const std::uint32_t* deviceIds, size_t n,
+                              std::int64_t from, std::int64_t to, double* seconds) {
+    std::int64_t clipped[ROW_BATCH];
+    bool avx2 = useAvx2();
+    for (size_t begin = 0; begin < n; begin += ROW_BATCH) {
+        size_t count = std::min(ROW_BATCH, n - begin);
+#if SMART_HOME_HAVE_AVX2
+        if (avx2) {
+            clippedRowsAvx2(onTimes + begin, offTimes + begin, count, from, to, clipped);
+        } else {
+            clippedRowsScalar(onTimes + begin, offTimes + begin, count, from, to, clipped);
+        }
+#else
+        (void)avx2;
+        clippedRowsScalar(onTimes + begin, offTimes + begin, count, from, to, clipped);
+#endif
+        for (size_t i = 0; i < count; ++i) {
+            seconds[deviceIds[begin + i]] += static_cast<double>(clipped[i]);
+        }
+    }
+}
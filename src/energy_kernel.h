@@ -0,0 +1,49 @@
+//Project name : Smart Home Automation
+//file name : energy_kernel.h
+
+#ifndef SMART_HOME_ENERGY_KERNEL_H
+#define SMART_HOME_ENERGY_KERNEL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+
+#include "device_registry.h"
+
+// Batch kernels over activation intervals, used by the house-wide reports.
+// Each kernel has a portable scalar version and, on x86 with GCC or Clang,
+// an AVX2 version picked at run time. Both give bit-identical results.
+
+enum EnergyKernel {
+    KERNEL_SCALAR,
+    KERNEL_AVX2
+};
+
+// The kernel in use: the best one the CPU supports, unless the environment
+// variable SMART_HOME_KERNEL=scalar or forceEnergyKernel() says otherwise
+EnergyKernel activeEnergyKernel();
+
+// Use 'kernel' from now on if the CPU supports it; returns the kernel in effect
+EnergyKernel forceEnergyKernel(EnergyKernel kernel);
+
+const char* energyKernelName(EnergyKernel kernel);
+
+// Active seconds and energy (kWh) of n devices from their running totals,
+// evaluating open records up to 'now':
+//   activeSeconds[i] = closedSeconds[i] + (openOnTimes[i] != 0 ? now - openOnTimes[i] : 0)
+//   energy[i]        = (powerRatings[i] / 1000) * (activeSeconds[i] / 3600)
+void deviceTotals(const double* closedSeconds, const std::time_t* openOnTimes, const double* powerRatings,
+                  size_t n, std::time_t now, double* activeSeconds, double* energy);
+
+// Seconds of n records that fall inside [from, to), with open records
+// (offTime == 0) running until 'now'
+std::int64_t clippedSeconds(const ActivationRecord* records, size_t n,
+                            std::time_t from, std::time_t to, std::time_t now);
+
+// Add the seconds of n history rows that fall inside [from, to) to
+// seconds[deviceIds[i]]
+void accumulateClippedSeconds(const std::int64_t* onTimes, const std::int64_t* offTimes,
+                              const std::uint32_t* deviceIds, size_t n,
+                              std::int64_t from, std::int64_t to, double* seconds);
+
+#endif // SMART_HOME_ENERGY_KERNEL_H
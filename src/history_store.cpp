@@ -0,0 +1,7 @@
+//Project name : Smart Home Automation
+//file name : history_store.cpp
+
+#include "history_store.h"
+
+const std::uint32_t HistorySegment::MAGIC;
+const size_t HistorySegment::ROW_BYTES;
@@ -0,0 +1,290 @@
+//Project name : Smart Home Automation
+//file name : history_store.h
+
+#ifndef SMART_HOME_HISTORY_STORE_H
+#define SMART_HOME_HISTORY_STORE_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iomanip>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "device_registry.h"
+#include "journal.h"
+
+// Read-only memory mapping of a whole file; falls back to reading the file
+// into memory where mmap is not available
+class MappedFile {
+public:
+    MappedFile() : mapping(nullptr), length(0) {}
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    ~MappedFile() { close(); }
+
+    bool open(const std::string& path) {
+        close();
+#if defined(__unix__) || defined(__APPLE__)
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return false;
+        }
+        struct stat info;
+        if (::fstat(fd, &info) != 0) {
+            ::close(fd);
+            return false;
+        }
+        length = static_cast<size_t>(info.st_size);
+        if (length > 0) {
+            void* address = ::mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (address == MAP_FAILED) {
+                ::close(fd);
+                length = 0;
+                return false;
+            }
+            mapping = static_cast<const char*>(address);
+        }
+        ::close(fd);
+        return true;
+#else
+        if (!readFile(path, buffer)) {
+            return false;
+        }
+        mapping = buffer.data();
+        length = buffer.size();
+        return true;
+#endif
+    }
+
+    void close() {
+#if defined(__unix__) || defined(__APPLE__)
+        if (mapping) {
+            ::munmap(const_cast<char*>(mapping), length);
+        }
+#else
+        buffer.clear();
+#endif
+        mapping = nullptr;
+        length = 0;
+    }
+
+    const char* data() const { return mapping; }
+    size_t size() const { return length; }
+
+private:
+    const char* mapping;
+    size_t length;
+#if !defined(__unix__) && !defined(__APPLE__)
+    std::string buffer;
+#endif
+};
+
+// Columnar history segment: an immutable file holding the records of one
+// calendar month (UTC) as three columns
+//   header | i64 onTimes[n] | i64 offTimes[n] | u32 deviceIds[n]
+// sorted by ON time. Segments are mapped read-only and scanned in place.
+struct HistorySegment {
+    struct Header {
+        std::uint32_t magic;
+        std::uint32_t partition;   // year * 100 + month
+        std::uint64_t rowCount;
+        std::int64_t minOnTime;
+        std::int64_t maxOffTime;
+        std::uint32_t checksum;    // of the three columns
+        std::uint32_t reserved;    // zero; keeps the columns 8-byte aligned
+    };
+
+    static const std::uint32_t MAGIC = 0x53484844; // "DHHS", with a checksum
+    static const size_t ROW_BYTES = 2 * sizeof(std::int64_t) + sizeof(std::uint32_t);
+
+    std::string name;
+    MappedFile file;
+    Header header;
+    const std::int64_t* onTimes;
+    const std::int64_t* offTimes;
+    const std::uint32_t* deviceIds;
+
+    // Map the file and check it before anything reads the columns: the
+    // header, the length, the checksum, the ON time order, the time range
+    // and that every device id is below 'deviceCount'. A segment that fails
+    // any check is not used.
+    bool open(const std::string& path, size_t deviceCount) {
+        name = path;
+        if (!file.open(path) || file.size() < sizeof(Header)) {
+            return false;
+        }
+        std::memcpy(&header, file.data(), sizeof(Header));
+        size_t columnBytes = file.size() - sizeof(Header);
+        if (header.magic != MAGIC || header.rowCount > columnBytes / ROW_BYTES
+            || columnBytes != static_cast<size_t>(header.rowCount) * ROW_BYTES) {
+            return false;
+        }
+        const char* columns = file.data() + sizeof(Header);
+        if (checksum(columns, columnBytes) != header.checksum) {
+            return false;
+        }
+        size_t rows = static_cast<size_t>(header.rowCount);
+        onTimes = reinterpret_cast<const std::int64_t*>(columns);
+        offTimes = onTimes + rows;
+        deviceIds = reinterpret_cast<const std::uint32_t*>(offTimes + rows);
+        for (size_t i = 0; i < rows; ++i) {
+            if (deviceIds[i] >= deviceCount || onTimes[i] < header.minOnTime || offTimes[i] > header.maxOffTime
+                || offTimes[i] < onTimes[i] || (i > 0 && onTimes[i] < onTimes[i - 1])) {
+                return false;
+            }
+        }
+        return true;
+    }
+};
+
+// The set of history segments. Segment names are recorded in the snapshot,
+// so a segment only becomes part of the history once a snapshot that no
+// longer holds its records in memory has been written.
+class HistoryStore {
+public:
+    std::uint32_t nextSegmentNumber;
+
+    HistoryStore() : nextSegmentNumber(0) {}
+
+    size_t segmentCount() const { return segments.size(); }
+
+    std::vector<std::string> segmentNames() const {
+        std::vector<std::string> names;
+        for (const auto& segment : segments) {
+            names.push_back(segment->name);
+        }
+        return names;
+    }
+
+    // Earliest ON time and latest OFF time stored; false when there is no history
+    bool timeRange(std::int64_t& minOnTime, std::int64_t& maxOffTime) const {
+        for (size_t i = 0; i < segments.size(); ++i) {
+            const HistorySegment::Header& header = segments[i]->header;
+            minOnTime = i == 0 ? header.minOnTime : std::min(minOnTime, header.minOnTime);
+            maxOffTime = i == 0 ? header.maxOffTime : std::max(maxOffTime, header.maxOffTime);
+        }
+        return !segments.empty();
+    }
+
+    // Map an existing segment file whose records all belong to devices
+    // below 'deviceCount'
+    bool addSegment(const std::string& path, size_t deviceCount) {
+        std::unique_ptr<HistorySegment> segment(new HistorySegment());
+        if (!segment->open(path, deviceCount)) {
+            return false;
+        }
+        segments.push_back(std::move(segment));
+        return true;
+    }
+
+    // Write 'rows' as new segments, one per month partition, and map them;
+    // every row's device must be below 'deviceCount'
+    bool append(std::vector<HistoryRow>& rows, const std::string& prefix, size_t deviceCount) {
+        size_t existing = segments.size();
+        std::sort(rows.begin(), rows.end(), [](const HistoryRow& a, const HistoryRow& b) {
+            return a.onTime < b.onTime;
+        });
+        size_t begin = 0;
+        while (begin < rows.size()) {
+            std::uint32_t partition = partitionOf(rows[begin].onTime);
+            size_t end = begin + 1;
+            while (end < rows.size() && partitionOf(rows[end].onTime) == partition) {
+                ++end;
+            }
+            std::ostringstream path;
+            path << prefix << "." << partition << "." << nextSegmentNumber++;
+            if (!writeSegment(path.str(), partition, &rows[begin], end - begin) || !addSegment(path.str(), deviceCount)) {
+                segments.resize(existing);
+                return false;
+            }
+            begin = end;
+        }
+        return true;
+    }
+
+    // Visit the column ranges that may overlap [from, to) as
+    // fn(onTimes, offTimes, deviceIds, rows): whole segments outside the range
+    // are skipped and each range stops before the first ON time >= 'to'.
+    // Rows inside a range can still end before 'from'.
+    template <typename Fn>
+    void scanColumns(std::time_t from, std::time_t to, Fn fn) const {
+        for (const auto& segment : segments) {
+            const HistorySegment::Header& header = segment->header;
+            if (header.minOnTime >= to || header.maxOffTime <= from) {
+                continue;
+            }
+            const std::int64_t* onTimes = segment->onTimes;
+            size_t rows = static_cast<size_t>(std::lower_bound(onTimes, onTimes + header.rowCount,
+                                                               static_cast<std::int64_t>(to)) - onTimes);
+            fn(onTimes, segment->offTimes, segment->deviceIds, rows);
+        }
+    }
+
+    // Visit every stored record overlapping [from, to) as fn(onTime, offTime, deviceId)
+    template <typename Fn>
+    void scan(std::time_t from, std::time_t to, Fn fn) const {
+        scanColumns(from, to, [&](const std::int64_t* onTimes, const std::int64_t* offTimes,
+                                  const std::uint32_t* deviceIds, size_t rows) {
+            for (size_t i = 0; i < rows; ++i) {
+                if (offTimes[i] > from) {
+                    fn(onTimes[i], offTimes[i], deviceIds[i]);
+                }
+            }
+        });
+    }
+
+private:
+    std::vector<std::unique_ptr<HistorySegment>> segments;
+
+    static std::uint32_t partitionOf(std::int64_t t) {
+        std::time_t time = static_cast<std::time_t>(t);
+        std::tm tm;
+#ifdef _WIN32
+        gmtime_s(&tm, &time);
+#else
+        gmtime_r(&time, &tm);
+#endif
+        return static_cast<std::uint32_t>((tm.tm_year + 1900) * 100 + tm.tm_mon + 1);
+    }
+
+    static bool writeSegment(const std::string& path, std::uint32_t partition, const HistoryRow* rows, size_t count) {
+        HistorySegment::Header header;
+        header.magic = HistorySegment::MAGIC;
+        header.partition = partition;
+        header.rowCount = count;
+        header.minOnTime = rows[0].onTime;
+        header.maxOffTime = rows[0].offTime;
+        header.reserved = 0;
+        ByteWriter onColumn, offColumn, deviceColumn;
+        for (size_t i = 0; i < count; ++i) {
+            header.maxOffTime = std::max(header.maxOffTime, rows[i].offTime);
+            onColumn.put(rows[i].onTime);
+            offColumn.put(rows[i].offTime);
+            deviceColumn.put(rows[i].deviceId);
+        }
+        header.checksum = checksum(onColumn.bytes.data(), onColumn.bytes.size());
+        header.checksum = checksum(offColumn.bytes.data(), offColumn.bytes.size(), header.checksum);
+        header.checksum = checksum(deviceColumn.bytes.data(), deviceColumn.bytes.size(), header.checksum);
+        std::FILE* file = std::fopen(path.c_str(), "wb");
+        if (!file) {
+            return false;
+        }
+        bool written = std::fwrite(&header, sizeof(header), 1, file) == 1
+            && std::fwrite(onColumn.bytes.data(), 1, onColumn.bytes.size(), file) == onColumn.bytes.size()
+            && std::fwrite(offColumn.bytes.data(), 1, offColumn.bytes.size(), file) == offColumn.bytes.size()
+            && std::fwrite(deviceColumn.bytes.data(), 1, deviceColumn.bytes.size(), file) == deviceColumn.bytes.size();
+        return std::fclose(file) == 0 && written;
+    }
+};
+
+#endif // SMART_HOME_HISTORY_STORE_H
@@ -0,0 +1,569 @@
+//Project name : Smart Home Automation
+//file name : home.cpp
+
+#include "home.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <map>
+
+#include "metrics.h"
+
+const size_t Home::NO_ROOM;
+const size_t Home::NO_DEVICE;
+
+void readStatus(const Home& home, StatusView& view) {
+    view.roomEnds.clear();
+    view.deviceIds.clear();
+    size_t roomCount = home.publishedRooms.size();
+    for (size_t r = 0; r < roomCount; ++r) {
+        const PublishedList<std::uint32_t>& ids = home.publishedRooms[r].deviceIds;
+        size_t deviceCount = ids.size();
+        for (size_t d = 0; d < deviceCount; ++d) {
+            view.deviceIds.push_back(ids[d]);
+        }
+        view.roomEnds.push_back(view.deviceIds.size());
+    }
+    home.registry.statusBits.snapshot(view.statusWords);
+}
+
+bool switchDevice(Home& home, size_t deviceId, bool on, std::time_t at) {
+    SMART_HOME_TIMED(METRIC_SWITCH_DEVICE);
+    DeviceRegistry& registry = home.registry;
+    if (registry.status(deviceId) == on) {
+        return false;
+    }
+    registry.setStatus(deviceId, on);
+    // Metered energy is only loaded after the journal replay, so the
+    // monitor sits it out rather than learn from the rated estimate
+    if (on) {
+        if (!home.replaying) {
+            home.activity.switchedOn(deviceId, at, registry.energyConsumed(deviceId, at));
+        }
+        registry.openRecord(deviceId, at);
+    } else if (registry.hasOpenRecord(deviceId)) {
+        std::time_t onTime = registry.openOnTimes[deviceId];
+        registry.closeRecord(deviceId, at);
+        home.rollup.add(registry.roomIds[deviceId], static_cast<std::uint32_t>(deviceId),
+            onTime, at, registry.powerRatings[deviceId]);
+        if (!home.replaying) {
+            home.activity.switchedOff(deviceId, onTime, at, registry.energyConsumed(deviceId, at));
+        }
+    }
+    home.trends.update(registry, deviceId);
+    ByteWriter payload;
+    payload.put(static_cast<std::uint32_t>(deviceId));
+    payload.put(static_cast<std::int64_t>(at));
+    logEvent(home, on ? JOURNAL_SWITCH_ON : JOURNAL_SWITCH_OFF, payload);
+    if (!on && registry.recordsInMemory() >= HISTORY_FLUSH_RECORDS) {
+        flushHistory(home);
+    }
+    return true;
+}
+
+// Call fn(minute of the week) for each weekly start of 'rule'. A one-off rule
+// holds its weekday's slot until it has run.
+template <typename Fn>
+void forEachWeeklyStart(const ScheduleRule& rule, Fn fn) {
+    const int DAY_MINUTES = 24 * 60;
+    if (!rule.repeat) {
+        int weekday;
+        localTimeOnDay(rule.startDay, 0, 0, &weekday);
+        if (rule.dayMask & (1u << weekday)) {
+            fn(weekday * DAY_MINUTES + rule.onMinute);
+        }
+        return;
+    }
+    for (int weekday = 0; weekday < 7; ++weekday) {
+        if (rule.dayMask & (1u << weekday)) {
+            fn(weekday * DAY_MINUTES + rule.onMinute);
+        }
+    }
+}
+
+std::int64_t scheduleMilliwatts(const Home& home, const ScheduleRule& rule) {
+    return std::llround(home.registry.powerRatings[rule.deviceId] * 1000.0);
+}
+
+// Add a rule's load to home.scheduledLoad, or remove it with sign -1
+void applyScheduleLoad(Home& home, const ScheduleRule& rule, int sign) {
+    std::int64_t milliwatts = sign * scheduleMilliwatts(home, rule);
+    forEachWeeklyStart(rule, [&](int start) {
+        home.scheduledLoad.add(start, rule.durationMinutes, milliwatts);
+    });
+}
+
+// 'rule' starting 'shift' minutes later; a start pushed past midnight moves
+// to the following day
+ScheduleRule shiftSchedule(const ScheduleRule& rule, int shift) {
+    const int DAY_MINUTES = 24 * 60;
+    ScheduleRule shifted = rule;
+    shifted.onMinute = rule.onMinute + shift;
+    if (shifted.onMinute >= DAY_MINUTES) {
+        shifted.onMinute -= DAY_MINUTES;
+        if (rule.repeat) {
+            shifted.dayMask = std::uint8_t(((rule.dayMask << 1) | (rule.dayMask >> 6)) & EVERY_DAY);
+        } else {
+            shifted.startDay = localTimeOnDay(rule.startDay, 1, 0, nullptr);
+        }
+    }
+    return shifted;
+}
+
+bool fitSchedule(const Home& home, ScheduleRule& rule, LoadPolicy policy) {
+    const int DAY_MINUTES = 24 * 60;
+    double cap = home.tariff.powerCap;
+    std::int64_t capMilliwatts = cap > 0.0 ? std::llround(cap * 1000.0) : INT64_MAX;
+    std::int64_t milliwatts = scheduleMilliwatts(home, rule);
+    if (milliwatts > capMilliwatts) {
+        return false;
+    }
+
+    // Running sum of the time-of-use rate over two weeks, so a start late in
+    // the week can run into the next one
+    std::vector<double> rateSum;
+    if (policy == LOAD_CHEAPEST) {
+        rateSum.resize(2 * LoadProfile::WEEK_MINUTES + 1, 0.0);
+        for (int minute = 0; minute < 2 * LoadProfile::WEEK_MINUTES; ++minute) {
+            int weekMinute = minute % LoadProfile::WEEK_MINUTES;
+            rateSum[minute + 1] = rateSum[minute] + home.tariff.rateAt(weekMinute / DAY_MINUTES, weekMinute % DAY_MINUTES);
+        }
+    }
+
+    // Shifting moves every weekly start by the same amount, so a minute over
+    // the cap rules out all shifts that would still cover it
+    int lastShift = policy == LOAD_REJECT ? 0 : MAX_LOAD_SHIFT_MINUTES;
+    bool found = false;
+    int bestShift = 0;
+    double bestCost = 0.0;
+    for (int shift = 0; shift <= lastShift; ) {
+        ScheduleRule candidate = shiftSchedule(rule, shift);
+        int blocked = -1;
+        double cost = 0.0;
+        forEachWeeklyStart(candidate, [&](int start) {
+            blocked = std::max(blocked, home.scheduledLoad.lastAbove(start, candidate.durationMinutes,
+                                                                     capMilliwatts - milliwatts));
+            if (!rateSum.empty()) {
+                cost += rateSum[start + candidate.durationMinutes] - rateSum[start];
+            }
+        });
+        if (blocked >= 0) {
+            shift += blocked + 1;
+            continue;
+        }
+        if (policy != LOAD_CHEAPEST) {
+            rule = candidate;
+            return true;
+        }
+        if (!found || cost < bestCost) {
+            found = true;
+            bestShift = shift;
+            bestCost = cost;
+        }
+        ++shift;
+    }
+    if (found) {
+        rule = shiftSchedule(rule, bestShift);
+    }
+    return found;
+}
+
+// Queue the next transition of a schedule rule at or after 'after'. An
+// occurrence already in progress switches the device ON right away.
+// Caller holds home.mutex.
+void armSchedule(Home& home, size_t ruleId, std::time_t after) {
+    SMART_HOME_TIMED(METRIC_SCHEDULE_ARM);
+    ScheduleRule& rule = home.schedules[ruleId];
+    ActivationRecord occurrence;
+    if (!nextOccurrence(rule, after, occurrence)) {
+        rule.active = false;
+        applyScheduleLoad(home, rule, -1);
+        return;
+    }
+    rule.pendingOff = occurrence.offTime;
+    if (occurrence.onTime <= after) {
+        switchDevice(home, rule.deviceId, true, after);
+        rule.pending = home.scheduler.schedule(rule.deviceId, occurrence.offTime, false, ruleId);
+    } else {
+        rule.pending = home.scheduler.schedule(rule.deviceId, occurrence.onTime, true, ruleId);
+    }
+}
+
+size_t addSchedule(Home& home, const ScheduleRule& rule, std::time_t now) {
+    size_t ruleId = home.schedules.size();
+    home.schedules.push_back(rule);
+    home.schedules.back().active = true;
+    ByteWriter payload;
+    payload.put(static_cast<std::uint32_t>(rule.deviceId));
+    payload.put(static_cast<std::int32_t>(rule.onMinute));
+    payload.put(static_cast<std::int32_t>(rule.durationMinutes));
+    payload.put(rule.dayMask);
+    payload.put(static_cast<std::uint8_t>(rule.repeat));
+    payload.put(static_cast<std::int64_t>(rule.startDay));
+    logEvent(home, JOURNAL_SCHEDULE_ADDED, payload);
+    applyScheduleLoad(home, home.schedules.back(), 1);
+    armSchedule(home, ruleId, now);
+    return ruleId;
+}
+
+bool cancelSchedule(Home& home, size_t ruleId) {
+    if (ruleId >= home.schedules.size() || !home.schedules[ruleId].active) {
+        return false;
+    }
+    ScheduleRule& rule = home.schedules[ruleId];
+    rule.active = false;
+    home.scheduler.cancel(rule.pending);
+    applyScheduleLoad(home, rule, -1);
+    ByteWriter payload;
+    payload.put(static_cast<std::uint32_t>(ruleId));
+    logEvent(home, JOURNAL_SCHEDULE_CANCELLED, payload);
+    return true;
+}
+
+// Scheduler callback: apply the due transition and queue the rule's next one
+void onTimerEvent(Home& home, const TimerEvent& event) {
+    SMART_HOME_TIMED(METRIC_TIMER_FIRE);
+    std::lock_guard<std::mutex> lock(home.mutex);
+    ScheduleRule& rule = home.schedules[event.ruleId];
+    if (!rule.active) {
+        return;
+    }
+    switchDevice(home, event.deviceId, event.turnOn, event.due);
+    if (event.turnOn) {
+        rule.pending = home.scheduler.schedule(event.deviceId, rule.pendingOff, false, event.ruleId);
+    } else {
+        armSchedule(home, event.ruleId, event.due);
+    }
+}
+
+Home::Home() : telemetry(registry), replaying(false), clock(&systemClock()), virtualClock(nullptr), reportPool(nullptr),
+    scheduler([this](const TimerEvent& event) { onTimerEvent(*this, event); }) {}
+
+void useVirtualClock(Home& home, VirtualClock& clock) {
+    home.clock = &clock;
+    home.virtualClock = &clock;
+    home.registry.clock = &clock;
+    home.scheduler.runManually();
+}
+
+bool advanceClock(Home& home, std::time_t to) {
+    VirtualClock* clock = home.virtualClock;
+    if (clock == nullptr || to < clock->now()) {
+        return false;
+    }
+    std::time_t due;
+    while (home.scheduler.nextDue(due) && due <= to) {
+        // Events left over from before the clock started fire at its time
+        clock->set(std::max(due, clock->now()));
+        home.scheduler.runDue(due);
+    }
+    clock->set(to);
+    return true;
+}
+
+bool writeSnapshot(Home& home) {
+    SMART_HOME_TIMED(METRIC_SNAPSHOT);
+    home.telemetry.flush();
+    const DeviceRegistry& registry = home.registry;
+    ByteWriter out;
+    out.put(SNAPSHOT_MAGIC);
+    out.put(SNAPSHOT_VERSION);
+    out.put(home.journal.lastSequence());
+
+    out.put(static_cast<std::uint32_t>(home.rooms.size()));
+    for (const auto& room : home.rooms) {
+        out.putString(room.name);
+    }
+
+    out.put(static_cast<std::uint32_t>(registry.size()));
+    for (size_t id = 0; id < registry.size(); ++id) {
+        out.put(registry.roomIds[id]);
+        out.put(registry.powerRatings[id]);
+        out.putString(registry.name(id));
+        out.put(static_cast<std::uint8_t>(registry.status(id)));
+        out.put(registry.closedActiveSeconds[id]);
+        out.put(registry.recordCounts[id]);
+        registry.forEachRecord(id, [&](const ActivationRecord& record) {
+            out.put(static_cast<std::int64_t>(record.onTime));
+            out.put(static_cast<std::int64_t>(record.offTime));
+        });
+    }
+
+    out.put(static_cast<std::uint32_t>(home.schedules.size()));
+    for (const auto& rule : home.schedules) {
+        out.put(static_cast<std::uint32_t>(rule.deviceId));
+        out.put(static_cast<std::int32_t>(rule.onMinute));
+        out.put(static_cast<std::int32_t>(rule.durationMinutes));
+        out.put(rule.dayMask);
+        out.put(static_cast<std::uint8_t>(rule.repeat));
+        out.put(static_cast<std::int64_t>(rule.startDay));
+        out.put(static_cast<std::uint8_t>(rule.active));
+    }
+
+    out.put(home.history.nextSegmentNumber);
+    std::vector<std::string> segments = home.history.segmentNames();
+    out.put(static_cast<std::uint32_t>(segments.size()));
+    for (const auto& segment : segments) {
+        out.putString(segment);
+    }
+    home.rollup.write(out);
+    home.activity.write(out);
+    home.telemetry.write(out);
+    out.put(checksum(out.bytes.data(), out.bytes.size()));
+
+    std::string tempPath = std::string(SNAPSHOT_PATH) + ".tmp";
+    std::FILE* file = std::fopen(tempPath.c_str(), "wb");
+    if (!file) {
+        return false;
+    }
+    bool written = std::fwrite(out.bytes.data(), 1, out.bytes.size(), file) == out.bytes.size();
+    written = std::fclose(file) == 0 && written;
+#ifdef _WIN32
+    std::remove(SNAPSHOT_PATH);
+#endif
+    if (!written || std::rename(tempPath.c_str(), SNAPSHOT_PATH) != 0) {
+        std::remove(tempPath.c_str());
+        return false;
+    }
+    home.journal.truncate();
+    home.telemetry.truncate();
+    return true;
+}
+
+// Move the closed records held in memory into new history segments. They
+// become part of the history with the snapshot written right after, which
+// no longer holds them; until then a crash simply keeps them in memory.
+// Does nothing while the journal is closed (e.g. during replay).
+// Caller holds home.mutex.
+bool flushHistory(Home& home) {
+    if (!home.journal.isOpen()) {
+        return false;
+    }
+    std::vector<HistoryRow> rows;
+    home.registry.collectClosedRecords(rows);
+    if (rows.empty()) {
+        return true;
+    }
+    if (!home.history.append(rows, HISTORY_PREFIX, home.registry.size())) {
+        return false;
+    }
+    home.registry.dropClosedRecords();
+    return writeSnapshot(home);
+}
+
+// Journal an event and take a snapshot once enough entries have accumulated
+void logEvent(Home& home, std::uint8_t type, const ByteWriter& payload) {
+    if (!home.journal.isOpen()) {
+        return;
+    }
+    home.journal.append(type, payload);
+    if (home.journal.entriesSinceSnapshot() >= SNAPSHOT_INTERVAL) {
+        writeSnapshot(home);
+    }
+}
+
+ScheduleRule readScheduleRule(ByteReader& in, bool& ok) {
+    ScheduleRule rule;
+    std::uint32_t deviceId = 0;
+    std::int32_t onMinute = 0, durationMinutes = 0;
+    std::uint8_t repeat = 0;
+    std::int64_t startDay = 0;
+    ok = in.get(deviceId) && in.get(onMinute) && in.get(durationMinutes)
+        && in.get(rule.dayMask) && in.get(repeat) && in.get(startDay);
+    rule.deviceId = deviceId;
+    rule.onMinute = onMinute;
+    rule.durationMinutes = durationMinutes;
+    rule.repeat = repeat != 0;
+    rule.startDay = static_cast<std::time_t>(startDay);
+    rule.active = true;
+    rule.pending = 0;
+    rule.pendingOff = 0;
+    return rule;
+}
+
+// Load a snapshot into an empty home and store its journal sequence number
+// in 'sequence' (0 when there is no snapshot). Returns false for a corrupt
+// snapshot.
+bool loadSnapshot(Home& home, const std::string& path, std::uint64_t& sequence) {
+    sequence = 0;
+    std::string contents;
+    if (!readFile(path, contents)) {
+        return true;
+    }
+    if (contents.size() < sizeof(std::uint32_t)) {
+        return false;
+    }
+    size_t bodySize = contents.size() - sizeof(std::uint32_t);
+    std::uint32_t storedChecksum;
+    std::memcpy(&storedChecksum, contents.data() + bodySize, sizeof(storedChecksum));
+    if (checksum(contents.data(), bodySize) != storedChecksum) {
+        return false;
+    }
+
+    ByteReader in(contents.data(), bodySize);
+    std::uint32_t magic, version, count;
+    if (!in.get(magic) || magic != SNAPSHOT_MAGIC || !in.get(version) || version != SNAPSHOT_VERSION
+        || !in.get(sequence) || !in.get(count)) {
+        return false;
+    }
+    for (std::uint32_t i = 0; i < count; ++i) {
+        std::string name;
+        if (!in.getString(name)) {
+            return false;
+        }
+        home.addRoom(name);
+    }
+
+    DeviceRegistry& registry = home.registry;
+    if (!in.get(count)) {
+        return false;
+    }
+    for (std::uint32_t i = 0; i < count; ++i) {
+        std::uint32_t roomId, recordCount;
+        double powerRating, closedSeconds;
+        std::string name;
+        std::uint8_t status;
+        if (!in.get(roomId) || !in.get(powerRating) || !in.getString(name) || !in.get(status)
+            || !in.get(closedSeconds) || !in.get(recordCount) || roomId >= home.rooms.size()) {
+            return false;
+        }
+        size_t id = home.addDevice(roomId, name, powerRating).id();
+        registry.setStatus(id, status != 0);
+        for (std::uint32_t r = 0; r < recordCount; ++r) {
+            std::int64_t onTime, offTime;
+            if (!in.get(onTime) || !in.get(offTime)) {
+                return false;
+            }
+            if (offTime == 0) {
+                registry.openRecord(id, static_cast<std::time_t>(onTime));
+            } else {
+                ActivationRecord record;
+                record.onTime = static_cast<std::time_t>(onTime);
+                record.offTime = static_cast<std::time_t>(offTime);
+                registry.addClosedRecord(id, record);
+            }
+        }
+        registry.closedActiveSeconds[id] = closedSeconds;
+    }
+
+    if (!in.get(count)) {
+        return false;
+    }
+    for (std::uint32_t i = 0; i < count; ++i) {
+        bool ok;
+        ScheduleRule rule = readScheduleRule(in, ok);
+        std::uint8_t active;
+        if (!ok || !in.get(active) || rule.deviceId >= registry.size()) {
+            return false;
+        }
+        rule.active = active != 0;
+        home.schedules.push_back(rule);
+    }
+
+    if (!in.get(home.history.nextSegmentNumber) || !in.get(count)) {
+        return false;
+    }
+    for (std::uint32_t i = 0; i < count; ++i) {
+        std::string segment;
+        if (!in.getString(segment) || !home.history.addSegment(segment, registry.size())) {
+            return false;
+        }
+    }
+    return home.rollup.read(in) && home.activity.read(in, registry.size()) && home.telemetry.read(in);
+}
+
+bool restoreHome(Home& home, std::time_t now, size_t& replayed) {
+    std::lock_guard<std::mutex> lock(home.mutex);
+    std::uint64_t snapshotSequence;
+    replayed = 0;
+    if (!loadSnapshot(home, SNAPSHOT_PATH, snapshotSequence)) {
+        return false;
+    }
+    std::uint64_t lastSequence = snapshotSequence;
+
+    std::string contents;
+    readFile(JOURNAL_PATH, contents);
+    home.replaying = true;
+    size_t intact = replayJournal(contents, [&](std::uint8_t type, std::uint64_t sequence, ByteReader& in) {
+        if (sequence <= snapshotSequence) {
+            return;
+        }
+        lastSequence = sequence;
+        ++replayed;
+        std::uint32_t id, roomId;
+        std::int64_t at;
+        double powerRating;
+        std::string name;
+        bool ok;
+        switch (type) {
+            case JOURNAL_ROOM_ADDED:
+                if (in.getString(name)) {
+                    home.addRoom(name);
+                }
+                break;
+            case JOURNAL_DEVICE_ADDED:
+                if (in.get(roomId) && in.get(powerRating) && in.getString(name) && roomId < home.rooms.size()) {
+                    home.addDevice(roomId, name, powerRating);
+                }
+                break;
+            case JOURNAL_SWITCH_ON:
+            case JOURNAL_SWITCH_OFF:
+                if (in.get(id) && in.get(at) && id < home.registry.size()) {
+                    switchDevice(home, id, type == JOURNAL_SWITCH_ON, static_cast<std::time_t>(at));
+                }
+                break;
+            case JOURNAL_SCHEDULE_ADDED: {
+                ScheduleRule rule = readScheduleRule(in, ok);
+                if (ok && rule.deviceId < home.registry.size()) {
+                    home.schedules.push_back(rule);
+                }
+                break;
+            }
+            case JOURNAL_SCHEDULE_CANCELLED:
+                if (in.get(id) && id < home.schedules.size()) {
+                    home.schedules[id].active = false;
+                }
+                break;
+        }
+    });
+    home.replaying = false;
+
+    if (intact < contents.size()) {
+        // Drop a torn tail so new entries are appended after intact data
+        std::FILE* file = std::fopen(JOURNAL_PATH, "wb");
+        if (file) {
+            std::fwrite(contents.data(), 1, intact, file);
+            std::fclose(file);
+        }
+    }
+    home.journal.open(JOURNAL_PATH, lastSequence);
+    home.telemetry.open(TELEMETRY_PATH);
+    home.trends.rebuild(home.registry, home.rooms.size());
+
+    // An OFF a rule would have applied while the program was not running
+    // still happened: close each device left ON at its earliest such OFF
+    // time before the rules are armed again, or a one-off rule that is over
+    // would leave its device ON for good
+    std::map<size_t, std::time_t> missedOff;
+    for (const ScheduleRule& rule : home.schedules) {
+        ActivationRecord occurrence;
+        if (rule.active && home.registry.hasOpenRecord(rule.deviceId)
+            && nextOccurrence(rule, home.registry.openOnTimes[rule.deviceId], occurrence) && occurrence.offTime <= now) {
+            auto it = missedOff.insert(std::make_pair(rule.deviceId, occurrence.offTime)).first;
+            it->second = std::min(it->second, occurrence.offTime);
+        }
+    }
+    for (const auto& off : missedOff) {
+        switchDevice(home, off.first, false, off.second);
+    }
+
+    for (size_t ruleId = 0; ruleId < home.schedules.size(); ++ruleId) {
+        if (home.schedules[ruleId].active) {
+            applyScheduleLoad(home, home.schedules[ruleId], 1);
+            armSchedule(home, ruleId, now);
+        }
+    }
+    return true;
+}
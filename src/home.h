@@ -0,0 +1,216 @@
+//Project name : Smart Home Automation
+//file name : home.h
+
+#ifndef SMART_HOME_HOME_H
+#define SMART_HOME_HOME_H
+
+#include <cstdint>
+#include <ctime>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "activity_monitor.h"
+#include "clock.h"
+#include "device_registry.h"
+#include "history_store.h"
+#include "journal.h"
+#include "load_profile.h"
+#include "schedule_rule.h"
+#include "scheduler.h"
+#include "tariff.h"
+#include "telemetry.h"
+#include "trend_index.h"
+#include "usage_rollup.h"
+
+struct Home;
+void logEvent(Home& home, std::uint8_t type, const ByteWriter& payload);
+bool flushHistory(Home& home);
+
+const size_t HISTORY_FLUSH_RECORDS = 1 << 16;   // records kept in memory before a flush
+
+// Room and device names published for lock-free status readers; entries are
+// immutable once committed
+struct PublishedDevice {
+    std::string name;
+    double powerRating;
+};
+
+struct PublishedRoom {
+    std::string name;
+    PublishedList<std::uint32_t> deviceIds;
+};
+
+// The whole system state: the device registry and the rooms viewing into it.
+// 'mutex' guards the registry and rooms against the scheduler thread and
+// other clients. Status readers skip it and use the published lists and the
+// registry's status bits instead.
+struct Home {
+    DeviceRegistry registry;
+    std::vector<Room> rooms;
+    PublishedList<PublishedRoom> publishedRooms;
+    PublishedList<PublishedDevice> publishedDevices;
+    // Name indexes; a duplicate name (allowed by older versions) keeps
+    // resolving to the first room or device that used it
+    std::unordered_map<std::string, std::uint32_t> roomsByName;
+    std::unordered_map<std::uint64_t, std::uint32_t> devicesByName;   // room index << 32 | name id
+
+    static const size_t NO_ROOM = SIZE_MAX;
+    static const size_t NO_DEVICE = SIZE_MAX;
+    std::vector<ScheduleRule> schedules;
+    Journal journal;
+    HistoryStore history;
+    TelemetryStore telemetry;   // metered power samples
+    UsageRollup rollup;
+    ActivityMonitor activity;   // per-device baselines for spotting unusual activations
+    TrendIndex trends;          // top rooms and devices, kept as devices switch
+    bool replaying;             // set while restoreHome applies the journal tail
+    const Clock* clock;         // source of "now"; the system clock unless time is simulated
+    VirtualClock* virtualClock; // the same clock when time is simulated, else null
+    mutable std::mutex mutex;
+    Tariff tariff;
+    LoadProfile scheduledLoad;   // weekly load of the active schedules
+    ThreadPool* reportPool;   // spreads report aggregation over cores; null runs it inline
+    // Last, so its thread is stopped before anything its callbacks touch
+    // is destroyed
+    Scheduler scheduler;
+
+    Home();
+    Home(const Home&) = delete;
+    Home& operator=(const Home&) = delete;
+
+    std::time_t now() const { return clock->now(); }
+
+    // Index of the room with the given name, or NO_ROOM
+    size_t findRoom(const std::string& name) const {
+        auto it = roomsByName.find(name);
+        return it == roomsByName.end() ? NO_ROOM : it->second;
+    }
+
+    // Id of the named device in a room, or NO_DEVICE
+    size_t findDevice(size_t roomIndex, const std::string& name) const {
+        std::uint32_t nameId;
+        if (!registry.findName(name, nameId)) {
+            return NO_DEVICE;
+        }
+        auto it = devicesByName.find(deviceKey(roomIndex, nameId));
+        return it == devicesByName.end() ? NO_DEVICE : it->second;
+    }
+
+    Room& addRoom(std::string name) {
+        roomsByName.emplace(name, static_cast<std::uint32_t>(rooms.size()));
+        publishedRooms.next().name = name;
+        publishedRooms.commit();
+        trends.addRoom();
+        ByteWriter payload;
+        payload.putString(name);
+        rooms.emplace_back(std::move(name));
+        logEvent(*this, JOURNAL_ROOM_ADDED, payload);
+        return rooms.back();
+    }
+
+    // Create a device in the given room and return its view
+    Device& addDevice(size_t roomIndex, const std::string& name, double powerRating) {
+        size_t id = registry.addDevice(static_cast<std::uint32_t>(roomIndex), name, powerRating);
+        activity.addDevice();
+        trends.addDevice(registry, id);
+        rooms[roomIndex].devices.emplace_back(registry, id);
+        devicesByName.emplace(deviceKey(roomIndex, registry.nameIds[id]), static_cast<std::uint32_t>(id));
+        PublishedDevice& published = publishedDevices.next();
+        published.name = name;
+        published.powerRating = powerRating;
+        publishedDevices.commit();
+        publishedRooms[roomIndex].deviceIds.push_back(static_cast<std::uint32_t>(id));
+        ByteWriter payload;
+        payload.put(static_cast<std::uint32_t>(roomIndex));
+        payload.put(powerRating);
+        payload.putString(name);
+        logEvent(*this, JOURNAL_DEVICE_ADDED, payload);
+        return rooms[roomIndex].devices.back();
+    }
+
+private:
+    static std::uint64_t deviceKey(size_t roomIndex, std::uint32_t nameId) {
+        return (std::uint64_t(roomIndex) << 32) | nameId;
+    }
+};
+
+// Rooms, devices and status bits as of one moment, read without home.mutex
+struct StatusView {
+    std::vector<size_t> roomEnds;            // end of each room's range in 'deviceIds'
+    std::vector<std::uint32_t> deviceIds;
+    std::vector<std::uint64_t> statusWords;
+
+    bool status(size_t id) const { return (statusWords[id / 64] >> (id % 64)) & 1u; }
+};
+
+// Safe to call while other threads add devices or switch them. The status
+// bits are copied last, so they cover every device listed.
+void readStatus(const Home& home, StatusView& view);
+
+// Apply an ON/OFF transition at the given time; returns false when the
+// device already was in the requested state. Outside journal replay each
+// closed activation is also judged by home.activity. Caller holds home.mutex.
+bool switchDevice(Home& home, size_t deviceId, bool on, std::time_t at);
+
+// Run the home on 'clock' instead of the wall clock. The scheduler stops
+// using its thread; due events then fire only from advanceClock. Call before
+// restoreHome or anything else that schedules.
+void useVirtualClock(Home& home, VirtualClock& clock);
+
+// Move the virtual clock forward to 'to', firing the schedule events due on
+// the way, each with the clock set to its due time. Returns false, leaving
+// the clock alone, without a virtual clock or when 'to' is in its past.
+// Caller must not hold home.mutex.
+bool advanceClock(Home& home, std::time_t to);
+
+// How fitSchedule treats a rule that would take the scheduled load over
+// home.tariff.powerCap
+enum LoadPolicy {
+    LOAD_REJECT,     // keep the requested time or refuse the rule
+    LOAD_DELAY,      // start at the earliest time that fits
+    LOAD_CHEAPEST    // start at the time that fits and costs least under home.tariff
+};
+
+const int MAX_LOAD_SHIFT_MINUTES = 24 * 60;  // furthest a schedule is moved
+
+// Check a new rule against the power cap, moving its ON time forward by up
+// to MAX_LOAD_SHIFT_MINUTES as 'policy' allows. Each candidate start costs a
+// few peak queries on home.scheduledLoad. Returns false, leaving 'rule'
+// untouched, when no start fits. Caller holds home.mutex.
+bool fitSchedule(const Home& home, ScheduleRule& rule, LoadPolicy policy);
+
+// Register a schedule rule and arm its first occurrence; returns the rule id.
+// Caller holds home.mutex.
+size_t addSchedule(Home& home, const ScheduleRule& rule, std::time_t now);
+
+// Stop a schedule rule; returns false for unknown or finished rules.
+// Caller holds home.mutex.
+bool cancelSchedule(Home& home, size_t ruleId);
+
+// Persistent state files, relative to the working directory
+const char* const JOURNAL_PATH = "smart_home.journal";
+const char* const SNAPSHOT_PATH = "smart_home.snapshot";
+const char* const TARIFF_PATH = "smart_home.tariff";     // optional, read at startup
+const char* const TELEMETRY_PATH = "smart_home.telemetry";
+const std::uint32_t SNAPSHOT_MAGIC = 0x53484D53; // "SMHS"
+const std::uint32_t SNAPSHOT_VERSION = 6;
+const char* const HISTORY_PREFIX = "smart_home.history";
+const size_t SNAPSHOT_INTERVAL = 100000;         // journal entries between snapshots
+
+// Write a compact snapshot of the whole home and truncate the journal and
+// the sample file it supersedes. The snapshot is written to a temporary file and renamed into
+// place, so a crash leaves either the old or the new snapshot intact.
+// Buffered power samples are written out first. Caller holds home.mutex.
+bool writeSnapshot(Home& home);
+
+// Rebuild the home from the last snapshot plus the journal tail written after
+// it, then open the journal and the power sample file for appending, re-rank
+// home.trends and re-arm the schedules. A device left ON whose schedule
+// should have switched it OFF before 'now' is switched OFF at that time.
+// 'replayed' receives the number of journal entries applied. Returns false,
+// leaving the files untouched, when the snapshot is corrupt.
+bool restoreHome(Home& home, std::time_t now, size_t& replayed);
+
+#endif // SMART_HOME_HOME_H
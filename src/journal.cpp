@@ -0,0 +1,29 @@
+//Project name : Smart Home Automation
+//file name : journal.cpp
+
+#include "journal.h"
+
+std::uint32_t checksum(const char* data, size_t size, std::uint32_t hash) {
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= static_cast<unsigned char>(data[i]);
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+bool readFile(const std::string& path, std::string& contents) {
+    std::FILE* file = std::fopen(path.c_str(), "rb");
+    if (!file) {
+        return false;
+    }
+    contents.clear();
+    char buffer[1 << 16];
+    size_t count;
+    while ((count = std::fread(buffer, 1, sizeof(buffer), file)) > 0) {
+        contents.append(buffer, count);
+    }
+    std::fclose(file);
+    return true;
+}
+
+const size_t Journal::HEADER_SIZE;
@@ -0,0 +1,187 @@
+//Project name : Smart Home Automation
+//file name : journal.h
+
+#ifndef SMART_HOME_JOURNAL_H
+#define SMART_HOME_JOURNAL_H
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+// Growable byte buffer for the binary journal and snapshot formats
+class ByteWriter {
+public:
+    std::string bytes;
+
+    template <typename T>
+    void put(const T& value) {
+        bytes.append(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+
+    void putString(const std::string& text) {
+        put(static_cast<std::uint32_t>(text.size()));
+        bytes.append(text);
+    }
+};
+
+// Bounds-checked reader over a byte range; every get fails once data runs out
+class ByteReader {
+public:
+    ByteReader(const char* d, size_t n) : data(d), size(n), position(0) {}
+
+    template <typename T>
+    bool get(T& value) {
+        if (size - position < sizeof(T)) {
+            return false;
+        }
+        std::memcpy(&value, data + position, sizeof(T));
+        position += sizeof(T);
+        return true;
+    }
+
+    bool getString(std::string& text) {
+        std::uint32_t length;
+        if (!get(length) || size - position < length) {
+            return false;
+        }
+        text.assign(data + position, length);
+        position += length;
+        return true;
+    }
+
+    size_t offset() const { return position; }
+
+private:
+    const char* data;
+    size_t size;
+    size_t position;
+};
+
+// FNV-1a checksum used to detect torn or corrupted journal entries
+std::uint32_t checksum(const char* data, size_t size, std::uint32_t hash = 2166136261u);
+
+// Read a whole file into memory; returns false when it cannot be opened
+bool readFile(const std::string& path, std::string& contents);
+
+// Journal entry types
+enum JournalEntryType {
+    JOURNAL_ROOM_ADDED = 1,
+    JOURNAL_DEVICE_ADDED = 2,
+    JOURNAL_SWITCH_ON = 3,
+    JOURNAL_SWITCH_OFF = 4,
+    JOURNAL_SCHEDULE_ADDED = 5,
+    JOURNAL_SCHEDULE_CANCELLED = 6
+};
+
+// Append-only binary journal. Each entry is framed as
+//   u32 payload size | u32 checksum | u8 type | u64 sequence | payload
+// and the checksum covers type, sequence and payload.
+class Journal {
+public:
+    static const size_t HEADER_SIZE = 2 * sizeof(std::uint32_t);
+
+    bool autoFlush;   // flush after every entry; batch callers flush themselves
+
+    Journal() : autoFlush(true), file(nullptr), sequence(0), sinceSnapshot(0) {}
+    ~Journal() { close(); }
+
+    bool isOpen() const { return file != nullptr; }
+    std::uint64_t lastSequence() const { return sequence; }
+    size_t entriesSinceSnapshot() const { return sinceSnapshot; }
+
+    // Open for appending after the given sequence number
+    bool open(const std::string& p, std::uint64_t lastSeq) {
+        close();
+        path = p;
+        file = std::fopen(path.c_str(), "ab");
+        if (!file) {
+            return false;
+        }
+        std::setvbuf(file, nullptr, _IOFBF, 1 << 16);
+        sequence = lastSeq;
+        return true;
+    }
+
+    void close() {
+        if (file) {
+            std::fclose(file);
+            file = nullptr;
+        }
+    }
+
+    void flush() {
+        if (file) {
+            std::fflush(file);
+        }
+    }
+
+    // Append one entry; a no-op while the journal is closed (e.g. during replay)
+    void append(std::uint8_t type, const ByteWriter& payload) {
+        if (!file) {
+            return;
+        }
+        // type | sequence | payload, written in place so appends do not allocate
+        char prefix[sizeof(type) + sizeof(sequence)];
+        ++sequence;
+        std::memcpy(prefix, &type, sizeof(type));
+        std::memcpy(prefix + sizeof(type), &sequence, sizeof(sequence));
+        std::uint32_t header[2] = {
+            static_cast<std::uint32_t>(sizeof(prefix) + payload.bytes.size()),
+            checksum(payload.bytes.data(), payload.bytes.size(), checksum(prefix, sizeof(prefix)))
+        };
+        std::fwrite(header, sizeof(header), 1, file);
+        std::fwrite(prefix, sizeof(prefix), 1, file);
+        std::fwrite(payload.bytes.data(), 1, payload.bytes.size(), file);
+        ++sinceSnapshot;
+        if (autoFlush) {
+            std::fflush(file);
+        }
+    }
+
+    // Drop every entry; called once a snapshot covering them is on disk
+    void truncate() {
+        if (!file) {
+            return;
+        }
+        std::fclose(file);
+        file = std::fopen(path.c_str(), "wb");
+        if (file) {
+            std::setvbuf(file, nullptr, _IOFBF, 1 << 16);
+        }
+        sinceSnapshot = 0;
+    }
+
+private:
+    std::string path;
+    std::FILE* file;
+    std::uint64_t sequence;
+    size_t sinceSnapshot;
+};
+
+// Visit every intact journal entry as fn(type, sequence, reader). Returns the
+// length of the intact prefix; anything after it is a torn or corrupt tail.
+template <typename Fn>
+size_t replayJournal(const std::string& contents, Fn fn) {
+    size_t offset = 0;
+    while (contents.size() - offset >= Journal::HEADER_SIZE) {
+        std::uint32_t header[2];
+        std::memcpy(header, contents.data() + offset, sizeof(header));
+        size_t bodyOffset = offset + Journal::HEADER_SIZE;
+        std::uint32_t bodySize = header[0];
+        if (bodySize < 1 + sizeof(std::uint64_t) || contents.size() - bodyOffset < bodySize
+            || checksum(contents.data() + bodyOffset, bodySize) != header[1]) {
+            break;
+        }
+        ByteReader reader(contents.data() + bodyOffset, bodySize);
+        std::uint8_t type;
+        std::uint64_t sequence;
+        reader.get(type);
+        reader.get(sequence);
+        fn(type, sequence, reader);
+        offset = bodyOffset + bodySize;
+    }
+    return offset;
+}
+
+#endif // SMART_HOME_JOURNAL_H
@@ -0,0 +1,101 @@
+//Project name : Smart Home Automation
+//file name : load_profile.cpp
+
+#include "load_profile.h"
+
+#include <algorithm>
+#include <climits>
+
+const int LoadProfile::WEEK_MINUTES;
+const int LoadProfile::LEAVES;
+
+void LoadProfile::add(int start, int length, std::int64_t milliwatts) {
+    if (length <= 0) {
+        return;
+    }
+    start %= WEEK_MINUTES;
+    length = std::min(length, WEEK_MINUTES);
+    int end = start + length;
+    addRange(1, 0, LEAVES, start, std::min(end, WEEK_MINUTES), milliwatts);
+    if (end > WEEK_MINUTES) {
+        addRange(1, 0, LEAVES, 0, end - WEEK_MINUTES, milliwatts);
+    }
+}
+
+std::int64_t LoadProfile::peak(int start, int length) const {
+    if (length <= 0) {
+        return 0;
+    }
+    start %= WEEK_MINUTES;
+    length = std::min(length, WEEK_MINUTES);
+    int end = start + length;
+    std::int64_t result = peakRange(1, 0, LEAVES, start, std::min(end, WEEK_MINUTES));
+    if (end > WEEK_MINUTES) {
+        result = std::max(result, peakRange(1, 0, LEAVES, 0, end - WEEK_MINUTES));
+    }
+    return result;
+}
+
+int LoadProfile::lastAbove(int start, int length, std::int64_t threshold) const {
+    if (length <= 0) {
+        return -1;
+    }
+    start %= WEEK_MINUTES;
+    length = std::min(length, WEEK_MINUTES);
+    int end = start + length;
+    if (end > WEEK_MINUTES) {
+        int wrapped = lastAboveRange(1, 0, LEAVES, 0, end - WEEK_MINUTES, threshold);
+        if (wrapped >= 0) {
+            return WEEK_MINUTES - start + wrapped;
+        }
+    }
+    int minute = lastAboveRange(1, 0, LEAVES, start, std::min(end, WEEK_MINUTES), threshold);
+    return minute >= 0 ? minute - start : -1;
+}
+
+void LoadProfile::clear() {
+    std::fill(peaks.begin(), peaks.end(), 0);
+    std::fill(pending.begin(), pending.end(), 0);
+}
+
+void LoadProfile::addRange(int node, int nodeBegin, int nodeEnd, int begin, int end, std::int64_t milliwatts) {
+    if (end <= nodeBegin || nodeEnd <= begin) {
+        return;
+    }
+    if (begin <= nodeBegin && nodeEnd <= end) {
+        pending[node] += milliwatts;
+        peaks[node] += milliwatts;
+        return;
+    }
+    int middle = (nodeBegin + nodeEnd) / 2;
+    addRange(2 * node, nodeBegin, middle, begin, end, milliwatts);
+    addRange(2 * node + 1, middle, nodeEnd, begin, end, milliwatts);
+    peaks[node] = std::max(peaks[2 * node], peaks[2 * node + 1]) + pending[node];
+}
+
+std::int64_t LoadProfile::peakRange(int node, int nodeBegin, int nodeEnd, int begin, int end) const {
+    if (end <= nodeBegin || nodeEnd <= begin) {
+        return LLONG_MIN;
+    }
+    if (begin <= nodeBegin && nodeEnd <= end) {
+        return peaks[node];
+    }
+    int middle = (nodeBegin + nodeEnd) / 2;
+    std::int64_t below = std::max(peakRange(2 * node, nodeBegin, middle, begin, end),
+                                  peakRange(2 * node + 1, middle, nodeEnd, begin, end));
+    return below + pending[node];
+}
+
+int LoadProfile::lastAboveRange(int node, int nodeBegin, int nodeEnd, int begin, int end, std::int64_t threshold) const {
+    if (end <= nodeBegin || nodeEnd <= begin || peaks[node] <= threshold) {
+        return -1;
+    }
+    if (nodeEnd - nodeBegin == 1) {
+        return nodeBegin;
+    }
+    // The children's peaks exclude this node's pending add
+    int middle = (nodeBegin + nodeEnd) / 2;
+    threshold -= pending[node];
+    int minute = lastAboveRange(2 * node + 1, middle, nodeEnd, begin, end, threshold);
+    return minute >= 0 ? minute : lastAboveRange(2 * node, nodeBegin, middle, begin, end, threshold);
+}
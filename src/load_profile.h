@@ -0,0 +1,50 @@
+//Project name : Smart Home Automation
+//file name : load_profile.h
+
+#ifndef SMART_HOME_LOAD_PROFILE_H
+#define SMART_HOME_LOAD_PROFILE_H
+
+#include <cstdint>
+#include <vector>
+
+// Power drawn by the scheduled devices over one local week, at minute
+// resolution. Minute 0 is Sunday 00:00, matching the day bits of schedule
+// rules. A segment tree with range add and range max keeps every update and
+// every peak query at O(log n), so admitting a schedule never rescans the
+// whole timeline. Loads are kept in milliwatts so removing a schedule exactly
+// undoes adding it.
+class LoadProfile {
+public:
+    static const int WEEK_MINUTES = 7 * 24 * 60;
+
+    LoadProfile() : peaks(2 * LEAVES, 0), pending(2 * LEAVES, 0) {}
+
+    // Add 'milliwatts' (negative to remove) over 'length' minutes from
+    // 'start', wrapping past the end of the week
+    void add(int start, int length, std::int64_t milliwatts);
+
+    // Highest load over 'length' minutes from 'start', wrapping likewise
+    std::int64_t peak(int start, int length) const;
+
+    // Offset from 'start' of the last minute within 'length' minutes whose
+    // load exceeds 'threshold', or -1 if there is none. A window placed
+    // anywhere up to that minute cannot fit either, so callers searching for
+    // a start can skip straight past it.
+    int lastAbove(int start, int length, std::int64_t threshold) const;
+
+    void clear();
+
+private:
+    static const int LEAVES = 16384;   // power of two >= WEEK_MINUTES
+
+    // peaks[node] is the maximum over the node's range, including the adds
+    // pending at the node but not those pending at its ancestors
+    std::vector<std::int64_t> peaks;
+    std::vector<std::int64_t> pending;
+
+    void addRange(int node, int nodeBegin, int nodeEnd, int begin, int end, std::int64_t milliwatts);
+    std::int64_t peakRange(int node, int nodeBegin, int nodeEnd, int begin, int end) const;
+    int lastAboveRange(int node, int nodeBegin, int nodeEnd, int begin, int end, std::int64_t threshold) const;
+};
+
+#endif // SMART_HOME_LOAD_PROFILE_H
@@ -0,0 +1,198 @@
+//Project name : Smart Home Automation
+//file name : metrics.cpp
+
+#include "metrics.h"
+
+#include <cmath>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+const int LatencyHistogram::SUB_BUCKET_BITS;
+const int LatencyHistogram::SUB_BUCKETS;
+const int LatencyHistogram::MAX_MAGNITUDE;
+const int LatencyHistogram::BUCKETS;
+
+LatencyHistogram::LatencyHistogram() : count(0), sum(0), max(0) {
+    for (auto& bucket : buckets) {
+        bucket.store(0, std::memory_order_relaxed);
+    }
+}
+
+int LatencyHistogram::bucketIndex(std::uint64_t value) {
+    if (value < std::uint64_t(SUB_BUCKETS)) {
+        return static_cast<int>(value);
+    }
+#if defined(__GNUC__)
+    int magnitude = 63 - __builtin_clzll(value);
+#else
+    int magnitude = 63;
+    while (!(value >> magnitude)) {
+        --magnitude;
+    }
+#endif
+    if (magnitude > MAX_MAGNITUDE) {
+        return BUCKETS - 1;
+    }
+    int sub = static_cast<int>((value >> (magnitude - SUB_BUCKET_BITS)) & (SUB_BUCKETS - 1));
+    return (magnitude - SUB_BUCKET_BITS + 1) * SUB_BUCKETS + sub;
+}
+
+std::uint64_t LatencyHistogram::bucketLowest(int index) {
+    if (index < SUB_BUCKETS) {
+        return static_cast<std::uint64_t>(index);
+    }
+    int magnitude = index / SUB_BUCKETS + SUB_BUCKET_BITS - 1;
+    std::uint64_t sub = static_cast<std::uint64_t>(index % SUB_BUCKETS);
+    return (std::uint64_t(SUB_BUCKETS) + sub) << (magnitude - SUB_BUCKET_BITS);
+}
+
+namespace {
+
+const char* const METRIC_NAMES[METRIC_COUNT] = {
+    "switch_device",
+    "timer_fire",
+    "schedule_arm",
+    "aggregate_usage",
+    "usage_query",
+    "command",
+    "snapshot"
+};
+
+const char* const METRIC_HELP[METRIC_COUNT] = {
+    "Time to switch a device ON or OFF",
+    "Time to apply a timer transition, including the wait for the home lock",
+    "Time to compute and queue the next transition of a schedule",
+    "Time to aggregate energy and activity for reports and trends",
+    "Time to answer a usage history query",
+    "Time to run one batch or server command",
+    "Time to write a snapshot"
+};
+
+// Histogram sets of every thread that has recorded something. Sets are never
+// freed, so a reader may still merge the figures of threads that have exited.
+std::mutex threadsMutex;
+std::vector<std::unique_ptr<LatencyHistogram[]> > threadSets;
+
+// Merged view of one metric across all threads
+struct MergedHistogram {
+    std::uint64_t count;
+    std::uint64_t sum;
+    std::uint64_t max;
+    std::vector<std::uint64_t> buckets;
+
+    // Nearest-rank quantile, as the midpoint of its bucket
+    double quantile(double q) const {
+        if (count == 0) {
+            return 0.0;
+        }
+        std::uint64_t rank = static_cast<std::uint64_t>(std::ceil(q * double(count)));
+        rank = rank == 0 ? 1 : rank;
+        std::uint64_t seen = 0;
+        for (int i = 0; i < LatencyHistogram::BUCKETS; ++i) {
+            seen += buckets[i];
+            if (seen >= rank) {
+                std::uint64_t low = LatencyHistogram::bucketLowest(i);
+                std::uint64_t high = i + 1 < LatencyHistogram::BUCKETS ? LatencyHistogram::bucketLowest(i + 1) : low + 1;
+                double middle = (double(low) + double(high - 1)) / 2.0;
+                return middle < double(max) ? middle : double(max);
+            }
+        }
+        return double(max);
+    }
+};
+
+MergedHistogram merge(MetricId metric) {
+    MergedHistogram merged;
+    merged.count = 0;
+    merged.sum = 0;
+    merged.max = 0;
+    merged.buckets.assign(LatencyHistogram::BUCKETS, 0);
+    std::lock_guard<std::mutex> lock(threadsMutex);
+    for (const auto& set : threadSets) {
+        const LatencyHistogram& histogram = set[metric];
+        merged.count += histogram.count.load(std::memory_order_relaxed);
+        merged.sum += histogram.sum.load(std::memory_order_relaxed);
+        std::uint64_t max = histogram.max.load(std::memory_order_relaxed);
+        merged.max = max > merged.max ? max : merged.max;
+        for (int i = 0; i < LatencyHistogram::BUCKETS; ++i) {
+            merged.buckets[i] += histogram.buckets[i].load(std::memory_order_relaxed);
+        }
+    }
+    return merged;
+}
+
+void appendSeconds(std::string& out, double nanoseconds) {
+    char buffer[32];
+    int length = std::snprintf(buffer, sizeof(buffer), "%.9g", nanoseconds / 1e9);
+    out.append(buffer, static_cast<size_t>(length));
+}
+
+void appendCount(std::string& out, std::uint64_t value) {
+    char buffer[24];
+    int length = std::snprintf(buffer, sizeof(buffer), "%llu", static_cast<unsigned long long>(value));
+    out.append(buffer, static_cast<size_t>(length));
+}
+
+} // namespace
+
+LatencyHistogram* threadHistograms() {
+    static thread_local LatencyHistogram* local = nullptr;
+    if (!local) {
+        std::unique_ptr<LatencyHistogram[]> set(new LatencyHistogram[METRIC_COUNT]);
+        local = set.get();
+        std::lock_guard<std::mutex> lock(threadsMutex);
+        threadSets.push_back(std::move(set));
+    }
+    return local;
+}
+
+void writeMetrics(bool json, std::string& out) {
+    static const double QUANTILES[] = { 0.5, 0.9, 0.99, 0.999 };
+    static const char* const QUANTILE_NAMES[] = { "0.5", "0.9", "0.99", "0.999" };
+    static const char* const JSON_QUANTILES[] = { "p50", "p90", "p99", "p999" };
+    if (json) {
+        out += "{";
+    }
+    for (int m = 0; m < METRIC_COUNT; ++m) {
+        MergedHistogram merged = merge(MetricId(m));
+        std::string name = std::string("smart_home_") + METRIC_NAMES[m] + "_seconds";
+        if (json) {
+            out += m ? ",\"" : "\"";
+            out += METRIC_NAMES[m];
+            out += "\":{\"count\":";
+            appendCount(out, merged.count);
+            out += ",\"sumSeconds\":";
+            appendSeconds(out, double(merged.sum));
+            for (size_t q = 0; q < 4; ++q) {
+                out += ",\"";
+                out += JSON_QUANTILES[q];
+                out += "Seconds\":";
+                appendSeconds(out, merged.quantile(QUANTILES[q]));
+            }
+            out += ",\"maxSeconds\":";
+            appendSeconds(out, double(merged.max));
+            out += '}';
+            continue;
+        }
+        out += "# HELP " + name + " " + METRIC_HELP[m] + "\n";
+        out += "# TYPE " + name + " summary\n";
+        for (size_t q = 0; q < 4; ++q) {
+            out += name + "{quantile=\"" + QUANTILE_NAMES[q] + "\"} ";
+            appendSeconds(out, merged.quantile(QUANTILES[q]));
+            out += '\n';
+        }
+        out += name + "_sum ";
+        appendSeconds(out, double(merged.sum));
+        out += '\n' + name + "_count ";
+        appendCount(out, merged.count);
+        out += '\n';
+        out += "# TYPE " + name + "_max gauge\n" + name + "_max ";
+        appendSeconds(out, double(merged.max));
+        out += '\n';
+    }
+    if (json) {
+        out += "}\n";
+    }
+}
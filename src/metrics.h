@@ -0,0 +1,102 @@
+//Project name : Smart Home Automation
+//file name : metrics.h
+
+#ifndef SMART_HOME_METRICS_H
+#define SMART_HOME_METRICS_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+// Build with SMART_HOME_METRICS=0 to compile every measurement out
+#ifndef SMART_HOME_METRICS
+#define SMART_HOME_METRICS 1
+#endif
+
+// Instrumented operations
+enum MetricId {
+    METRIC_SWITCH_DEVICE,
+    METRIC_TIMER_FIRE,
+    METRIC_SCHEDULE_ARM,
+    METRIC_AGGREGATE_USAGE,
+    METRIC_USAGE_QUERY,
+    METRIC_COMMAND,
+    METRIC_SNAPSHOT,
+    METRIC_COUNT
+};
+
+// Log-linear latency histogram in nanoseconds, HDR-style: values below 16 get
+// their own bucket, larger ones 16 buckets per power of two (about 6% wide).
+// Each thread owns one set, so recording is plain relaxed loads and stores;
+// readers add the sets of all threads together.
+class LatencyHistogram {
+public:
+    static const int SUB_BUCKET_BITS = 4;
+    static const int SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+    static const int MAX_MAGNITUDE = 48;                 // up to about 3 days
+    static const int BUCKETS = (MAX_MAGNITUDE - SUB_BUCKET_BITS + 2) * SUB_BUCKETS;
+
+    std::atomic<std::uint64_t> count;
+    std::atomic<std::uint64_t> sum;
+    std::atomic<std::uint64_t> max;
+    std::atomic<std::uint64_t> buckets[BUCKETS];
+
+    LatencyHistogram();
+
+    // Called only by the owning thread
+    void record(std::uint64_t nanoseconds) {
+        bump(count, 1);
+        bump(sum, nanoseconds);
+        if (nanoseconds > max.load(std::memory_order_relaxed)) {
+            max.store(nanoseconds, std::memory_order_relaxed);
+        }
+        bump(buckets[bucketIndex(nanoseconds)], 1);
+    }
+
+    static int bucketIndex(std::uint64_t value);
+    // Smallest value that falls into a bucket
+    static std::uint64_t bucketLowest(int index);
+
+private:
+    static void bump(std::atomic<std::uint64_t>& cell, std::uint64_t amount) {
+        cell.store(cell.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+    }
+};
+
+// Histograms of the calling thread, created on first use
+LatencyHistogram* threadHistograms();
+
+// Records the time spent in a scope
+class ScopedLatency {
+public:
+    explicit ScopedLatency(MetricId m) : metric(m), started(std::chrono::steady_clock::now()) {}
+
+    ~ScopedLatency() {
+        auto elapsed = std::chrono::steady_clock::now() - started;
+        threadHistograms()[metric].record(static_cast<std::uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()));
+    }
+
+    ScopedLatency(const ScopedLatency&) = delete;
+    ScopedLatency& operator=(const ScopedLatency&) = delete;
+
+private:
+    MetricId metric;
+    std::chrono::steady_clock::time_point started;
+};
+
+#define SMART_HOME_CONCAT_(a, b) a##b
+#define SMART_HOME_CONCAT(a, b) SMART_HOME_CONCAT_(a, b)
+
+#if SMART_HOME_METRICS
+#define SMART_HOME_TIMED(metric) ScopedLatency SMART_HOME_CONCAT(timedScope, __LINE__)(metric)
+#else
+#define SMART_HOME_TIMED(metric) do {} while (false)
+#endif
+
+// Append every metric, merged over all threads, in the Prometheus text
+// format or as JSON. Durations are reported in seconds.
+void writeMetrics(bool json, std::string& out);
+
+#endif // SMART_HOME_METRICS_H
@@ -0,0 +1,412 @@
+//Project name : Smart Home Automation
+//file name : report_writer.cpp
+
+#include "report_writer.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+#include "alloc_counter.h"
+#include "usage_report.h"
+
+void appendNumber(std::string& out, double value, int digits) {
+    // Whole numbers (ratings, counts) are common and print the same through
+    // appendInteger as through "%g" while they have at most 'digits' digits
+    static const double LIMITS[] = { 1.0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15 };
+    if (digits > 0 && digits <= 15 && std::fabs(value) < LIMITS[digits] && value == std::floor(value)
+        && !(value == 0.0 && std::signbit(value))) {
+        appendInteger(out, static_cast<long long>(value));
+        return;
+    }
+    char buffer[32];
+    int length = std::snprintf(buffer, sizeof(buffer), "%.*g", digits, value);
+    out.append(buffer, static_cast<size_t>(length));
+}
+
+void appendInteger(std::string& out, long long value) {
+    char buffer[24];
+    char* end = buffer + sizeof(buffer);
+    char* p = end;
+    unsigned long long magnitude = value < 0 ? 0ull - static_cast<unsigned long long>(value)
+                                             : static_cast<unsigned long long>(value);
+    do {
+        *--p = static_cast<char>('0' + magnitude % 10);
+        magnitude /= 10;
+    } while (magnitude != 0);
+    if (value < 0) {
+        *--p = '-';
+    }
+    out.append(p, static_cast<size_t>(end - p));
+}
+
+void appendJsonString(std::string& out, const std::string& text) {
+    out += '"';
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            char buffer[8];
+            std::snprintf(buffer, sizeof(buffer), "\\u%04x", c);
+            out += buffer;
+        } else {
+            out += c;
+        }
+    }
+    out += '"';
+}
+
+void appendCsvField(std::string& out, const std::string& text) {
+    if (text.find_first_of(",\"\r\n") == std::string::npos) {
+        out += text;
+        return;
+    }
+    out += '"';
+    for (char c : text) {
+        if (c == '"') {
+            out += '"';
+        }
+        out += c;
+    }
+    out += '"';
+}
+
+void writeOut(std::string& text) {
+    std::fwrite(text.data(), 1, text.size(), stdout);
+    std::fflush(stdout);
+    text.clear();
+}
+
+void writeStatus(const Home& home, ReportFormat format, std::string& out) {
+    StatusView view;
+    readStatus(home, view);
+    size_t begin = 0;
+    if (format == FORMAT_JSON) {
+        out += "{\"rooms\":[";
+    } else if (format == FORMAT_CSV) {
+        out += "room,id,device,status,powerRating\n";
+    }
+    for (size_t r = 0; r < view.roomEnds.size(); ++r) {
+        const std::string& roomName = home.publishedRooms[r].name;
+        if (format == FORMAT_JSON) {
+            out += r ? ",{\"name\":" : "{\"name\":";
+            appendJsonString(out, roomName);
+            out += ",\"devices\":[";
+        } else if (format == FORMAT_TEXT) {
+            out += "Room: ";
+            out += roomName;
+            out += '\n';
+        }
+        for (size_t d = begin; d < view.roomEnds[r]; ++d) {
+            size_t id = view.deviceIds[d];
+            const PublishedDevice& device = home.publishedDevices[id];
+            if (format == FORMAT_JSON) {
+                out += d > begin ? ",{\"id\":" : "{\"id\":";
+                appendInteger(out, static_cast<long long>(id));
+                out += ",\"name\":";
+                appendJsonString(out, device.name);
+                out += ",\"status\":";
+                out += view.status(id) ? "\"ON\"" : "\"OFF\"";
+                out += ",\"powerRating\":";
+                appendNumber(out, device.powerRating);
+                out += '}';
+            } else if (format == FORMAT_CSV) {
+                appendCsvField(out, roomName);
+                out += ',';
+                appendInteger(out, static_cast<long long>(id));
+                out += ',';
+                appendCsvField(out, device.name);
+                out += view.status(id) ? ",ON," : ",OFF,";
+                appendNumber(out, device.powerRating);
+                out += '\n';
+            } else {
+                out += " - ";
+                out += device.name;
+                out += view.status(id) ? ": ON\n" : ": OFF\n";
+            }
+        }
+        if (format == FORMAT_JSON) {
+            out += "]}";
+        }
+        begin = view.roomEnds[r];
+    }
+    if (format == FORMAT_JSON) {
+        out += "]}\n";
+    }
+}
+
+void writeReport(const Home& home, std::time_t now, ReportFormat format, std::string& out) {
+    UsageSummary summary = aggregateUsage(home, now, 0);
+    UsageCost cost = computeCosts(home, summary);
+    double totalCost = cost.total;
+    if (format == FORMAT_JSON) {
+        out += "{\"generatedAt\":";
+        appendInteger(out, static_cast<long long>(now));
+        out += ",\"rooms\":[";
+        for (size_t r = 0; r < summary.rooms.size(); ++r) {
+            out += r ? ",{\"name\":" : "{\"name\":";
+            appendJsonString(out, home.rooms[r].name);
+            out += ",\"energy\":";
+            appendNumber(out, summary.rooms[r].energy);
+            out += ",\"cost\":";
+            appendNumber(out, cost.rooms[r]);
+            out += '}';
+        }
+        out += "],\"totalEnergy\":";
+        appendNumber(out, summary.totalEnergy);
+        out += ",\"totalCost\":";
+        appendNumber(out, totalCost);
+        out += "}\n";
+        return;
+    }
+    if (format == FORMAT_CSV) {
+        // The house-wide totals come last, with an empty name
+        out += "scope,name,energy,cost\n";
+        for (size_t r = 0; r < summary.rooms.size(); ++r) {
+            out += "room,";
+            appendCsvField(out, home.rooms[r].name);
+            out += ',';
+            appendNumber(out, summary.rooms[r].energy);
+            out += ',';
+            appendNumber(out, cost.rooms[r]);
+            out += '\n';
+        }
+        out += "house,,";
+        appendNumber(out, summary.totalEnergy);
+        out += ',';
+        appendNumber(out, totalCost);
+        out += '\n';
+        return;
+    }
+    for (size_t r = 0; r < summary.rooms.size(); ++r) {
+        out += "Energy consumed in ";
+        out += home.rooms[r].name;
+        out += ": ";
+        appendNumber(out, summary.rooms[r].energy);
+        out += " kWh\n";
+    }
+    out += "Total Energy Consumed: ";
+    appendNumber(out, summary.totalEnergy);
+    out += " kWh\nTotal Cost: ";
+    appendNumber(out, totalCost);
+    out += " Fils\n";
+}
+
+void writeTrends(const Home& home, std::time_t now, size_t topN, ReportFormat format, std::string& out) {
+    const DeviceRegistry& registry = home.registry;
+    std::vector<TrendEntry> topRooms = home.trends.topEnergyRooms(registry, now, topN);
+    std::vector<TrendEntry> topEnergy = home.trends.topEnergyDevices(registry, now, topN);
+    std::vector<TrendEntry> topActive = home.trends.topActiveDevices(registry, now, topN);
+    const std::vector<TrendEntry>* rankings[2] = { &topEnergy, &topActive };
+    if (format == FORMAT_JSON) {
+        out += "{\"topEnergyRooms\":[";
+        for (size_t i = 0; i < topRooms.size(); ++i) {
+            out += i ? ",{\"room\":" : "{\"room\":";
+            appendJsonString(out, home.rooms[topRooms[i].id].name);
+            out += ",\"energy\":";
+            appendNumber(out, topRooms[i].value);
+            out += '}';
+        }
+        const char* const names[2] = { "],\"topEnergyDevices\":[", "],\"topActiveDevices\":[" };
+        for (int k = 0; k < 2; ++k) {
+            out += names[k];
+            for (size_t i = 0; i < rankings[k]->size(); ++i) {
+                size_t id = (*rankings[k])[i].id;
+                out += i ? ",{\"device\":" : "{\"device\":";
+                appendJsonString(out, registry.name(id));
+                out += ",\"room\":";
+                appendJsonString(out, home.rooms[registry.roomIds[id]].name);
+                out += ",\"energy\":";
+                appendNumber(out, registry.energyConsumed(id, now));
+                out += ",\"activeHours\":";
+                appendNumber(out, registry.totalActiveTime(id, now) / 3600.0);
+                out += '}';
+            }
+        }
+        out += "]}\n";
+        return;
+    }
+    if (format == FORMAT_CSV) {
+        // Rooms leave the device and active hours columns empty
+        out += "ranking,rank,room,device,energy,activeHours\n";
+        for (size_t i = 0; i < topRooms.size(); ++i) {
+            out += "topEnergyRooms,";
+            appendInteger(out, static_cast<long long>(i + 1));
+            out += ',';
+            appendCsvField(out, home.rooms[topRooms[i].id].name);
+            out += ",,";
+            appendNumber(out, topRooms[i].value);
+            out += ",\n";
+        }
+        const char* const names[2] = { "topEnergyDevices,", "topActiveDevices," };
+        for (int k = 0; k < 2; ++k) {
+            for (size_t i = 0; i < rankings[k]->size(); ++i) {
+                size_t id = (*rankings[k])[i].id;
+                out += names[k];
+                appendInteger(out, static_cast<long long>(i + 1));
+                out += ',';
+                appendCsvField(out, home.rooms[registry.roomIds[id]].name);
+                out += ',';
+                appendCsvField(out, registry.name(id));
+                out += ',';
+                appendNumber(out, registry.energyConsumed(id, now));
+                out += ',';
+                appendNumber(out, registry.totalActiveTime(id, now) / 3600.0);
+                out += '\n';
+            }
+        }
+        return;
+    }
+    for (const TrendEntry& room : topRooms) {
+        out += "Room consuming the most energy: ";
+        out += home.rooms[room.id].name;
+        out += " (";
+        appendNumber(out, room.value);
+        out += " kWh)\n";
+    }
+    for (const TrendEntry& device : topEnergy) {
+        out += "Device consuming the most energy: ";
+        out += registry.name(device.id);
+        out += " in ";
+        out += home.rooms[registry.roomIds[device.id]].name;
+        out += " (";
+        appendNumber(out, device.value);
+        out += " kWh)\n";
+    }
+    for (const TrendEntry& device : topActive) {
+        out += "Device activated for the longest time: ";
+        out += registry.name(device.id);
+        out += " in ";
+        out += home.rooms[registry.roomIds[device.id]].name;
+        out += " (";
+        appendNumber(out, device.value / 3600.0);
+        out += " hours)\n";
+    }
+}
+
+void writeAnomalies(const Home& home, std::time_t now, ReportFormat format, std::string& out) {
+    static const char* const KIND_NAMES[] = { "", "longRun", "highPower", "", "leftOn" };
+    std::vector<Anomaly> anomalies = findAnomalies(home, now);
+    const DeviceRegistry& registry = home.registry;
+    if (format == FORMAT_JSON) {
+        out += "{\"anomalies\":[";
+    } else if (format == FORMAT_CSV) {
+        out += "room,device,kind,value,usual,at\n";
+    }
+    for (size_t i = 0; i < anomalies.size(); ++i) {
+        const Anomaly& anomaly = anomalies[i];
+        const std::string& room = home.rooms[registry.roomIds[anomaly.deviceId]].name;
+        bool seconds = anomaly.kind != ANOMALY_HIGH_POWER;
+        if (format == FORMAT_JSON) {
+            out += i ? ",{\"device\":" : "{\"device\":";
+            appendJsonString(out, registry.name(anomaly.deviceId));
+            out += ",\"room\":";
+            appendJsonString(out, room);
+            out += ",\"kind\":\"";
+            out += KIND_NAMES[anomaly.kind];
+            out += "\",\"value\":";
+            appendNumber(out, anomaly.value);
+            out += ",\"usual\":";
+            appendNumber(out, anomaly.usual);
+            out += ",\"at\":";
+            appendInteger(out, static_cast<long long>(anomaly.at));
+            out += '}';
+            continue;
+        }
+        if (format == FORMAT_CSV) {
+            appendCsvField(out, room);
+            out += ',';
+            appendCsvField(out, registry.name(anomaly.deviceId));
+            out += ',';
+            out += KIND_NAMES[anomaly.kind];
+            out += ',';
+            appendNumber(out, anomaly.value);
+            out += ',';
+            appendNumber(out, anomaly.usual);
+            out += ',';
+            appendInteger(out, static_cast<long long>(anomaly.at));
+            out += '\n';
+            continue;
+        }
+        out += registry.name(anomaly.deviceId);
+        out += " in ";
+        out += room;
+        out += anomaly.kind == ANOMALY_LEFT_ON ? " has been on for " :
+               anomaly.kind == ANOMALY_LONG_RUN ? " last ran for " : " last drew ";
+        appendNumber(out, seconds ? anomaly.value / 3600.0 : anomaly.value);
+        out += seconds ? " hours (usually " : " W (usually ";
+        appendNumber(out, seconds ? anomaly.usual / 3600.0 : anomaly.usual);
+        out += seconds ? ")\n" : " W)\n";
+    }
+    if (format == FORMAT_JSON) {
+        out += "]}\n";
+    }
+}
+
+void writeUsage(const Home& home, BucketSize size, std::time_t from, std::time_t to, UsageScope scope,
+                size_t scopeId, std::time_t now, ReportFormat format, std::string& out) {
+    std::vector<BucketUsage> usage = queryUsage(home, size, from, to, scope, scopeId, now);
+    if (format == FORMAT_JSON) {
+        out += "{\"buckets\":[";
+        for (size_t i = 0; i < usage.size(); ++i) {
+            out += i ? ",{\"start\":" : "{\"start\":";
+            appendInteger(out, static_cast<long long>(usage[i].start));
+            out += ",\"energy\":";
+            appendNumber(out, usage[i].energy);
+            out += ",\"activeSeconds\":";
+            appendNumber(out, usage[i].activeSeconds);
+            out += '}';
+        }
+        out += "]}\n";
+        return;
+    }
+    if (format == FORMAT_CSV) {
+        out += "start,energy,activeSeconds\n";
+    }
+    const char* const separator = format == FORMAT_CSV ? "," : " ";
+    for (const auto& bucket : usage) {
+        appendInteger(out, static_cast<long long>(bucket.start));
+        out += separator;
+        appendNumber(out, bucket.energy);
+        out += format == FORMAT_CSV ? "," : " kWh ";
+        appendNumber(out, bucket.activeSeconds);
+        out += format == FORMAT_CSV ? "\n" : " s\n";
+    }
+}
+
+void writeStats(const Home& home, ReportFormat format, std::string& out) {
+    const RecordArena& arena = home.registry.recordArena();
+    const char* const names[] = { "devices", "recordsInMemory", "arenaBlocks", "arenaChunks", "heapAllocations",
+                                  "scheduledPeakWatts", "samplesStored", "samplesBuffered" };
+    std::uint64_t values[] = {
+        home.registry.size(),
+        home.registry.recordsInMemory(),
+        arena.blocksInUse(),
+        arena.chunkCount(),
+        heapAllocations.load(std::memory_order_relaxed),
+        static_cast<std::uint64_t>(home.scheduledLoad.peak(0, LoadProfile::WEEK_MINUTES) / 1000),
+        home.telemetry.storedSamples(),
+        home.telemetry.bufferedSamples()
+    };
+    if (format == FORMAT_JSON) {
+        out += "{";
+    } else if (format == FORMAT_CSV) {
+        out += "name,value\n";
+    }
+    for (size_t i = 0; i < sizeof(values) / sizeof(values[0]); ++i) {
+        if (format == FORMAT_JSON) {
+            out += i ? ",\"" : "\"";
+            out += names[i];
+            out += "\":";
+        } else {
+            out += names[i];
+            out += format == FORMAT_CSV ? ',' : ' ';
+        }
+        appendInteger(out, static_cast<long long>(values[i]));
+        out += format == FORMAT_JSON ? "" : "\n";
+    }
+    if (format == FORMAT_JSON) {
+        out += "}\n";
+    }
+}
@@ -0,0 +1,51 @@
+//Project name : Smart Home Automation
+//file name : report_writer.h
+
+#ifndef SMART_HOME_REPORT_WRITER_H
+#define SMART_HOME_REPORT_WRITER_H
+
+#include <ctime>
+#include <string>
+
+#include "home.h"
+
+// How a report is laid out: lines for people, one JSON object, or CSV with
+// a header row
+enum ReportFormat {
+    FORMAT_TEXT,
+    FORMAT_JSON,
+    FORMAT_CSV
+};
+
+// Formatting into a caller's buffer. None of these allocate once the buffer
+// has grown to the size of the report, so a buffer kept between reports
+// formats them without touching the heap.
+void appendNumber(std::string& out, double value, int digits = 10);
+void appendInteger(std::string& out, long long value);
+void appendJsonString(std::string& out, const std::string& text);
+void appendCsvField(std::string& out, const std::string& text);
+
+// Write 'text' to standard output in one call, then empty it; the buffer
+// keeps its capacity for the next report
+void writeOut(std::string& text);
+
+// Status of every device; does not need home.mutex
+void writeStatus(const Home& home, ReportFormat format, std::string& out);
+
+// Energy report. Caller holds home.mutex.
+void writeReport(const Home& home, std::time_t now, ReportFormat format, std::string& out);
+
+// Top-N rooms and devices. Caller holds home.mutex.
+void writeTrends(const Home& home, std::time_t now, size_t topN, ReportFormat format, std::string& out);
+
+// Devices flagged by home.activity. Caller holds home.mutex.
+void writeAnomalies(const Home& home, std::time_t now, ReportFormat format, std::string& out);
+
+// Usage per bucket. Caller holds home.mutex.
+void writeUsage(const Home& home, BucketSize size, std::time_t from, std::time_t to, UsageScope scope,
+                size_t scopeId, std::time_t now, ReportFormat format, std::string& out);
+
+// Memory counters. Caller holds home.mutex.
+void writeStats(const Home& home, ReportFormat format, std::string& out);
+
+#endif // SMART_HOME_REPORT_WRITER_H
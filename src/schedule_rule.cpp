@@ -0,0 +1,97 @@
+//Project name : Smart Home Automation
+//file name : schedule_rule.cpp
+
+#include "schedule_rule.h"
+
+#include <sstream>
+
+#include "time_util.h"
+
+std::time_t localTimeOnDay(std::time_t day, int dayOffset, int minutes, int* weekday) {
+    std::tm tm = localTime(day);
+    tm.tm_mday += dayOffset;
+    tm.tm_hour = 0;
+    tm.tm_min = minutes;
+    tm.tm_sec = 0;
+    tm.tm_isdst = -1;
+    std::time_t result = std::mktime(&tm);
+    if (weekday) {
+        *weekday = tm.tm_wday;
+    }
+    return result;
+}
+
+std::time_t startOfDay(std::time_t t) {
+    return localTimeOnDay(t, 0, 0, nullptr);
+}
+
+bool nextOccurrence(const ScheduleRule& rule, std::time_t after, ActivationRecord& occurrence) {
+    std::time_t base = startOfDay(std::max(after, rule.startDay));
+    // Start one day back so an overnight occurrence still running is found
+    int firstOffset = base > rule.startDay ? -1 : 0;
+    int lastOffset = rule.repeat ? 7 : 0;
+    for (int offset = firstOffset; offset <= lastOffset; ++offset) {
+        int weekday;
+        std::time_t day = localTimeOnDay(base, offset, 0, &weekday);
+        if (!rule.repeat && day != rule.startDay) {
+            continue;
+        }
+        if (!(rule.dayMask & (1u << weekday))) {
+            continue;
+        }
+        std::time_t onTime = localTimeOnDay(base, offset, rule.onMinute, nullptr);
+        std::time_t offTime = localTimeOnDay(base, offset, rule.onMinute + rule.durationMinutes, nullptr);
+        if (offTime > after) {
+            occurrence.onTime = onTime;
+            occurrence.offTime = offTime;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool parseDayMask(const std::string& text, std::uint8_t& mask) {
+    static const char* const DAY_NAMES[] = { "sun", "mon", "tue", "wed", "thu", "fri", "sat" };
+    auto parseDay = [](const std::string& token, int& day) {
+        if (token.size() == 1 && token[0] >= '0' && token[0] <= '7') {
+            day = (token[0] - '0') % 7; // cron allows 7 for Sunday
+            return true;
+        }
+        std::string lower(token);
+        std::transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
+        for (int i = 0; i < 7; ++i) {
+            if (lower == DAY_NAMES[i]) {
+                day = i;
+                return true;
+            }
+        }
+        return false;
+    };
+
+    if (text == "*") {
+        mask = EVERY_DAY;
+        return true;
+    }
+    mask = 0;
+    std::istringstream fields(text);
+    std::string field;
+    while (std::getline(fields, field, ',')) {
+        size_t dash = field.find('-');
+        int first, last;
+        if (dash == std::string::npos) {
+            if (!parseDay(field, first)) {
+                return false;
+            }
+            last = first;
+        } else if (!parseDay(field.substr(0, dash), first) || !parseDay(field.substr(dash + 1), last)) {
+            return false;
+        }
+        for (int day = first; ; day = (day + 1) % 7) {
+            mask |= std::uint8_t(1u << day);
+            if (day == last) {
+                break;
+            }
+        }
+    }
+    return mask != 0;
+}
@@ -0,0 +1,59 @@
+//Project name : Smart Home Automation
+//file name : schedule_rule.h
+
+#ifndef SMART_HOME_SCHEDULE_RULE_H
+#define SMART_HOME_SCHEDULE_RULE_H
+
+#include <cstdint>
+#include <ctime>
+#include <string>
+
+#include "device_registry.h"
+#include "scheduler.h"
+
+// Recurring schedule rule: ON at a local time of day for a fixed duration, on
+// the weekdays selected by 'dayMask' (bit 0 = Sunday ... bit 6 = Saturday).
+// An OFF time earlier than the ON time runs past midnight. Occurrences are
+// never stored; they are expanded on demand from the rule.
+struct ScheduleRule {
+    size_t deviceId;
+    int onMinute;            // minutes after local midnight
+    int durationMinutes;     // 1 .. 24 * 60
+    std::uint8_t dayMask;
+    bool repeat;             // false: only the occurrence on 'startDay'
+    std::time_t startDay;    // local midnight of the first day the rule applies
+    // Runtime state
+    bool active;
+    TimerQueue::Handle pending;
+    std::time_t pendingOff;  // OFF time of the occurrence in progress or next
+};
+
+const std::uint8_t EVERY_DAY = 0x7F;
+const std::uint8_t WEEKDAYS = 0x3E;
+const std::uint8_t WEEKENDS = 0x41;
+
+// Local midnight of the day 'dayOffset' days after the day containing 'day',
+// plus 'minutes'; DST transitions are resolved by mktime
+std::time_t localTimeOnDay(std::time_t day, int dayOffset, int minutes, int* weekday);
+
+std::time_t startOfDay(std::time_t t);
+
+// First occurrence of 'rule' that is still running or starts after 'after'.
+// Returns false when the rule has no further occurrences.
+bool nextOccurrence(const ScheduleRule& rule, std::time_t after, ActivationRecord& occurrence);
+
+// Visit every occurrence of 'rule' overlapping [from, to)
+template <typename Fn>
+void forEachOccurrence(const ScheduleRule& rule, std::time_t from, std::time_t to, Fn fn) {
+    ActivationRecord occurrence;
+    std::time_t cursor = from;
+    while (cursor < to && nextOccurrence(rule, cursor, occurrence) && occurrence.onTime < to) {
+        fn(occurrence);
+        cursor = occurrence.offTime;
+    }
+}
+
+// Parse a cron-style day-of-week field: "*", "1-5", "0,6", "mon-fri", "sat,sun"
+bool parseDayMask(const std::string& text, std::uint8_t& mask);
+
+#endif // SMART_HOME_SCHEDULE_RULE_H
@@ -0,0 +1,6 @@
+//Project name : Smart Home Automation
+//file name : scheduler.cpp
+
+#include "scheduler.h"
+
+const size_t TimerQueue::NOT_QUEUED;
@@ -0,0 +1,364 @@
+//Project name : Smart Home Automation
+//file name : scheduler.h
+
+#ifndef SMART_HOME_SCHEDULER_H
+#define SMART_HOME_SCHEDULER_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <ctime>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <climits>
+
+// Pending ON/OFF transition for one device
+struct TimerEvent {
+    std::time_t due;
+    size_t deviceId;
+    bool turnOn;
+    size_t ruleId;          // schedule rule that queued the event
+    std::uint64_t sequence; // keeps events due in the same second in FIFO order
+};
+
+// Indexed binary min-heap of timer events. Every pushed event gets a handle
+// that can cancel it in O(log n); handles carry a generation so a stale
+// handle never cancels a later event reusing the same slot.
+class TimerQueue {
+public:
+    typedef std::uint64_t Handle;
+
+    bool empty() const { return heap.empty(); }
+    size_t size() const { return heap.size(); }
+    const TimerEvent& top() const { return heap.front().event; }
+
+    Handle push(const TimerEvent& event) {
+        std::uint32_t slot;
+        if (!freeSlots.empty()) {
+            slot = freeSlots.back();
+            freeSlots.pop_back();
+        } else {
+            slot = static_cast<std::uint32_t>(positions.size());
+            positions.push_back(NOT_QUEUED);
+            generations.push_back(0);
+        }
+        Entry entry;
+        entry.event = event;
+        entry.slot = slot;
+        heap.push_back(entry);
+        positions[slot] = heap.size() - 1;
+        siftUp(heap.size() - 1);
+        return (Handle(generations[slot]) << 32) | slot;
+    }
+
+    TimerEvent pop() {
+        TimerEvent event = heap.front().event;
+        removeAt(0);
+        return event;
+    }
+
+    bool cancel(Handle handle) {
+        std::uint32_t slot = static_cast<std::uint32_t>(handle & 0xFFFFFFFFu);
+        std::uint32_t generation = static_cast<std::uint32_t>(handle >> 32);
+        if (slot >= positions.size() || generations[slot] != generation || positions[slot] == NOT_QUEUED) {
+            return false;
+        }
+        removeAt(positions[slot]);
+        return true;
+    }
+
+private:
+    static const size_t NOT_QUEUED = SIZE_MAX;
+
+    struct Entry {
+        TimerEvent event;
+        std::uint32_t slot;
+    };
+
+    std::vector<Entry> heap;
+    std::vector<size_t> positions;          // heap position per slot
+    std::vector<std::uint32_t> generations;
+    std::vector<std::uint32_t> freeSlots;
+
+    static bool earlier(const Entry& a, const Entry& b) {
+        return a.event.due < b.event.due
+            || (a.event.due == b.event.due && a.event.sequence < b.event.sequence);
+    }
+
+    void place(size_t pos, const Entry& entry) {
+        heap[pos] = entry;
+        positions[entry.slot] = pos;
+    }
+
+    void siftUp(size_t pos) {
+        Entry entry = heap[pos];
+        while (pos > 0) {
+            size_t parent = (pos - 1) / 2;
+            if (!earlier(entry, heap[parent])) {
+                break;
+            }
+            place(pos, heap[parent]);
+            pos = parent;
+        }
+        place(pos, entry);
+    }
+
+    void siftDown(size_t pos) {
+        Entry entry = heap[pos];
+        size_t count = heap.size();
+        while (true) {
+            size_t child = 2 * pos + 1;
+            if (child >= count) {
+                break;
+            }
+            if (child + 1 < count && earlier(heap[child + 1], heap[child])) {
+                ++child;
+            }
+            if (!earlier(heap[child], entry)) {
+                break;
+            }
+            place(pos, heap[child]);
+            pos = child;
+        }
+        place(pos, entry);
+    }
+
+    void removeAt(size_t pos) {
+        std::uint32_t slot = heap[pos].slot;
+        positions[slot] = NOT_QUEUED;
+        ++generations[slot];
+        freeSlots.push_back(slot);
+        Entry last = heap.back();
+        heap.pop_back();
+        if (pos < heap.size()) {
+            place(pos, last);
+            siftDown(pos);
+            siftUp(positions[last.slot]);
+        }
+    }
+};
+
+// Background scheduler: a single thread sleeps until the earliest pending
+// event is due, then hands it to the action callback. Under a virtual clock
+// the thread is never started and the owner fires events with runDue as it
+// moves the clock.
+class Scheduler {
+public:
+    typedef std::function<void(const TimerEvent&)> Action;
+
+    explicit Scheduler(Action a) : action(a), stopping(false), manual(false), nextSequence(0) {}
+
+    ~Scheduler() { stop(); }
+
+    // Queue a transition; the worker thread is started on first use
+    TimerQueue::Handle schedule(size_t deviceId, std::time_t due, bool turnOn, size_t ruleId) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!worker.joinable() && !stopping && !manual) {
+            worker = std::thread(&Scheduler::run, this);
+        }
+        TimerEvent event;
+        event.due = due;
+        event.deviceId = deviceId;
+        event.turnOn = turnOn;
+        event.ruleId = ruleId;
+        event.sequence = nextSequence++;
+        TimerQueue::Handle handle = queue.push(event);
+        if (queue.top().sequence == event.sequence) {
+            // New earliest deadline, wake the worker so it re-arms its wait
+            wakeup.notify_one();
+        }
+        return handle;
+    }
+
+    bool cancel(TimerQueue::Handle handle) {
+        std::lock_guard<std::mutex> lock(mutex);
+        return queue.cancel(handle);
+    }
+
+    size_t pending() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return queue.size();
+    }
+
+    // Leave firing to runDue; call before anything is scheduled
+    void runManually() {
+        std::lock_guard<std::mutex> lock(mutex);
+        manual = true;
+    }
+
+    // Due time of the earliest pending event; false when none is pending
+    bool nextDue(std::time_t& due) const {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (queue.empty()) {
+            return false;
+        }
+        due = queue.top().due;
+        return true;
+    }
+
+    // Fire, on the calling thread and in order, every event due at or before
+    // 'until', including those the actions queue on the way. Returns the
+    // number fired.
+    size_t runDue(std::time_t until) {
+        size_t fired = 0;
+        std::unique_lock<std::mutex> lock(mutex);
+        while (!queue.empty() && queue.top().due <= until) {
+            TimerEvent event = queue.pop();
+            lock.unlock();
+            action(event);
+            ++fired;
+            lock.lock();
+        }
+        return fired;
+    }
+
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wakeup.notify_one();
+        if (worker.joinable()) {
+            worker.join();
+        }
+    }
+
+private:
+    Action action;
+    std::thread worker;
+    mutable std::mutex mutex;
+    std::condition_variable wakeup;
+    TimerQueue queue;
+    bool stopping;
+    bool manual;    // no worker thread; events fire through runDue
+    std::uint64_t nextSequence;
+
+    void run() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (!stopping) {
+            if (queue.empty()) {
+                wakeup.wait(lock);
+                continue;
+            }
+            // The worker only runs on the wall clock
+            std::time_t due = queue.top().due;
+            if (std::time(nullptr) < due) {
+                wakeup.wait_until(lock, std::chrono::system_clock::from_time_t(due));
+                continue;
+            }
+            TimerEvent event = queue.pop();
+            lock.unlock();
+            action(event);
+            lock.lock();
+        }
+    }
+};
+
+// Fixed set of worker threads running queued tasks in FIFO order
+class ThreadPool {
+public:
+    explicit ThreadPool(size_t threads) : stopping(false) {
+        if (threads == 0) {
+            threads = 1;
+        }
+        for (size_t i = 0; i < threads; ++i) {
+            workers.emplace_back(&ThreadPool::run, this);
+        }
+    }
+
+    ~ThreadPool() { stop(); }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    size_t size() const { return workers.size(); }
+
+    void submit(std::function<void()> task) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            tasks.push_back(std::move(task));
+        }
+        wakeup.notify_one();
+    }
+
+    // Run the tasks already queued, then join the workers
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wakeup.notify_all();
+        for (auto& worker : workers) {
+            if (worker.joinable()) {
+                worker.join();
+            }
+        }
+    }
+
+private:
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()> > tasks;
+    std::mutex mutex;
+    std::condition_variable wakeup;
+    bool stopping;
+
+    void run() {
+        for (;;) {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                while (!stopping && tasks.empty()) {
+                    wakeup.wait(lock);
+                }
+                if (tasks.empty()) {
+                    return;
+                }
+                task = std::move(tasks.front());
+                tasks.pop_front();
+            }
+            task();
+        }
+    }
+};
+
+// Run fn(chunk) for every chunk in [0, chunks) and return once all are done.
+// The calling thread takes chunks too, so this finishes even when the pool
+// is busy; with no pool the chunks run inline in order.
+template <typename Fn>
+void runChunks(ThreadPool* pool, size_t chunks, Fn fn) {
+    if (pool == nullptr || chunks < 2) {
+        for (size_t chunk = 0; chunk < chunks; ++chunk) {
+            fn(chunk);
+        }
+        return;
+    }
+    std::atomic<size_t> nextChunk(0);
+    auto drain = [&]() {
+        for (size_t chunk = nextChunk.fetch_add(1); chunk < chunks; chunk = nextChunk.fetch_add(1)) {
+            fn(chunk);
+        }
+    };
+    std::mutex mutex;
+    std::condition_variable finished;
+    size_t helpers = std::min(pool->size(), chunks - 1);
+    size_t running = helpers;
+    for (size_t i = 0; i < helpers; ++i) {
+        pool->submit([&]() {
+            drain();
+            std::lock_guard<std::mutex> lock(mutex);
+            if (--running == 0) {
+                finished.notify_one();
+            }
+        });
+    }
+    drain();
+    std::unique_lock<std::mutex> lock(mutex);
+    finished.wait(lock, [&]() { return running == 0; });
+}
+
+#endif // SMART_HOME_SCHEDULER_H
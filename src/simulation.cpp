@@ -0,0 +1,149 @@
+//Project name : Smart Home Automation
+//file name : simulation.cpp
+
+#include "simulation.h"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <limits>
+#include <queue>
+#include <random>
+#include <vector>
+
+namespace {
+
+// A kind of appliance: the range of its power rating and how long it
+// usually stays ON
+struct DeviceKind {
+    const char* name;
+    double minWatts;
+    double maxWatts;
+    double usualOnMinutes;
+};
+
+const DeviceKind DEVICE_KINDS[] = {
+    { "light", 5.0, 60.0, 120.0 },
+    { "fan", 40.0, 90.0, 90.0 },
+    { "tv", 60.0, 200.0, 150.0 },
+    { "heater", 1000.0, 2500.0, 60.0 },
+    { "kettle", 1800.0, 3000.0, 4.0 },
+    { "washer", 500.0, 2200.0, 90.0 },
+    { "fridge", 100.0, 250.0, 20.0 },
+    { "charger", 5.0, 65.0, 180.0 },
+};
+const size_t DEVICE_KIND_COUNT = sizeof(DEVICE_KINDS) / sizeof(DEVICE_KINDS[0]);
+
+// A simulated device and the mean lengths of its ON and OFF spells
+struct SimulatedDevice {
+    size_t id;
+    bool on;
+    double meanOnSeconds;
+    double meanOffSeconds;
+};
+
+// Next switch of a simulated device; equal times go in device order
+struct SwitchEvent {
+    std::time_t at;
+    std::uint32_t device;
+
+    bool operator>(const SwitchEvent& other) const {
+        return at > other.at || (at == other.at && device > other.device);
+    }
+};
+
+// Uniform in [0, 1) from the top 53 bits. The standard distributions may
+// differ between libraries, so they are not used.
+double uniform(std::mt19937_64& random) {
+    return double(random() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+// Whole seconds, at least one, drawn from an exponential distribution
+std::time_t spell(std::mt19937_64& random, double meanSeconds) {
+    double seconds = -std::log(1.0 - uniform(random)) * meanSeconds;
+    return std::max<std::time_t>(1, static_cast<std::time_t>(seconds + 0.5));
+}
+
+std::string roomName(size_t index) {
+    return "sim" + std::to_string(index);
+}
+
+} // namespace
+
+bool simulateHousehold(Home& home, const SimulationPlan& plan, SimulationResult& result, std::string& error) {
+    if (home.virtualClock == nullptr) {
+        error = "simulation needs a virtual clock";
+        return false;
+    }
+    // Each count is checked alone first so the product cannot overflow
+    if (plan.rooms == 0 || plan.devicesPerRoom == 0 || plan.rooms > SIMULATION_MAX_DEVICES
+        || plan.devicesPerRoom > SIMULATION_MAX_DEVICES || plan.rooms * plan.devicesPerRoom > SIMULATION_MAX_DEVICES
+        || !(plan.togglesPerDay >= SIMULATION_MIN_TOGGLES_PER_DAY) || !(plan.togglesPerDay <= SIMULATION_MAX_TOGGLES_PER_DAY)
+        || !(plan.days > 0.0) || !(plan.days <= SIMULATION_MAX_DAYS)) {
+        error = "simulation plan out of range";
+        return false;
+    }
+    std::time_t start = home.now();
+    std::time_t length = static_cast<std::time_t>(plan.days * 86400.0 + 0.5);
+    if (start > std::numeric_limits<std::time_t>::max() - length) {
+        error = "simulation would run the clock past its end";
+        return false;
+    }
+    std::mt19937_64 random(plan.seed);
+    std::vector<SimulatedDevice> devices;
+    devices.reserve(plan.rooms * plan.devicesPerRoom);
+    double cycleSeconds = 86400.0 / plan.togglesPerDay;
+    {
+        std::lock_guard<std::mutex> lock(home.mutex);
+        size_t firstRoom = home.rooms.size();
+        for (size_t room = 0; room < plan.rooms; ++room) {
+            if (home.findRoom(roomName(firstRoom + room)) != Home::NO_ROOM) {
+                error = "room " + roomName(firstRoom + room) + " already exists";
+                return false;
+            }
+        }
+        for (size_t room = 0; room < plan.rooms; ++room) {
+            size_t roomIndex = firstRoom + room;
+            home.addRoom(roomName(roomIndex));
+            for (size_t i = 0; i < plan.devicesPerRoom; ++i) {
+                const DeviceKind& kind = DEVICE_KINDS[random() % DEVICE_KIND_COUNT];
+                double watts = std::floor(kind.minWatts + uniform(random) * (kind.maxWatts - kind.minWatts) + 0.5);
+                Device& device = home.addDevice(roomIndex, kind.name + std::to_string(i), watts);
+                SimulatedDevice simulated;
+                simulated.id = device.id();
+                simulated.on = false;
+                simulated.meanOnSeconds = std::min(kind.usualOnMinutes * 60.0, cycleSeconds / 2.0);
+                simulated.meanOffSeconds = cycleSeconds - simulated.meanOnSeconds;
+                devices.push_back(simulated);
+            }
+        }
+    }
+
+    // One pending event per device keeps the queue at the device count
+    // however long the run
+    std::time_t end = start + length;
+    std::priority_queue<SwitchEvent, std::vector<SwitchEvent>, std::greater<SwitchEvent> > events;
+    for (size_t i = 0; i < devices.size(); ++i) {
+        events.push(SwitchEvent{ start + spell(random, devices[i].meanOffSeconds), static_cast<std::uint32_t>(i) });
+    }
+    result.devices = devices.size();
+    result.switches = 0;
+    while (!events.empty() && events.top().at <= end) {
+        SwitchEvent event = events.top();
+        events.pop();
+        SimulatedDevice& device = devices[event.device];
+        device.on = !device.on;
+        advanceClock(home, event.at);
+        {
+            std::lock_guard<std::mutex> lock(home.mutex);
+            // A schedule may already have put the device in this state
+            if (switchDevice(home, device.id, device.on, event.at)) {
+                ++result.switches;
+            }
+        }
+        double mean = device.on ? device.meanOnSeconds : device.meanOffSeconds;
+        events.push(SwitchEvent{ event.at + spell(random, mean), event.device });
+    }
+    advanceClock(home, end);
+    return true;
+}
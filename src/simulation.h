@@ -0,0 +1,45 @@
+//Project name : Smart Home Automation
+//file name : simulation.h
+
+#ifndef SMART_HOME_SIMULATION_H
+#define SMART_HOME_SIMULATION_H
+
+#include <cstdint>
+#include <string>
+
+#include "home.h"
+
+// Bounds on a simulation plan, keeping one command's memory and event count
+// in reason and its times well inside std::time_t
+const size_t SIMULATION_MAX_DEVICES = 1000000;          // rooms times devices per room
+const double SIMULATION_MIN_TOGGLES_PER_DAY = 0.001;
+const double SIMULATION_MAX_TOGGLES_PER_DAY = 86400.0;  // one a second
+const double SIMULATION_MAX_DAYS = 36600.0;             // a century
+
+// Shape of a synthetic household
+struct SimulationPlan {
+    size_t rooms;
+    size_t devicesPerRoom;
+    double togglesPerDay;   // ON switches per device and day, on average
+    double days;
+    std::uint64_t seed;
+};
+
+struct SimulationResult {
+    size_t devices;     // devices added
+    size_t switches;    // ON and OFF transitions applied
+};
+
+// Add plan.rooms rooms named sim<index>, each with plan.devicesPerRoom
+// devices of assorted kinds and power ratings, then switch those devices
+// through plan.days of random use on the home's virtual clock, starting at
+// its current time. Events go through switchDevice in time order as fast as
+// they can be applied, with schedule events fired in between, so a run also
+// serves as a load generator for the switching path. The same plan, seed and
+// starting home always give the same result. Returns false with a message
+// in 'error', changing nothing, without a virtual clock, when a room name is
+// taken, or when the plan is outside the bounds above or would run the clock
+// past the end of std::time_t. Caller must not hold home.mutex.
+bool simulateHousehold(Home& home, const SimulationPlan& plan, SimulationResult& result, std::string& error);
+
+#endif // SMART_HOME_SIMULATION_H
@@ -0,0 +1,265 @@
+//Project name : Smart Home Automation
+//file name : tariff.cpp
+
+#include "tariff.h"
+
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+#include <iomanip>
+#include <limits>
+#include <sstream>
+
+#include "schedule_rule.h"
+
+namespace {
+
+// Parse "HH:MM" into minutes after midnight
+bool parseClockText(const std::string& text, int& minutes) {
+    if (text.size() != 5 || text[2] != ':') {
+        return false;
+    }
+    for (size_t i = 0; i < 5; ++i) {
+        if (i != 2 && !std::isdigit(static_cast<unsigned char>(text[i]))) {
+            return false;
+        }
+    }
+    int hours = (text[0] - '0') * 10 + (text[1] - '0');
+    int mins = (text[3] - '0') * 10 + (text[4] - '0');
+    if (hours > 23 || mins > 59) {
+        return false;
+    }
+    minutes = hours * 60 + mins;
+    return true;
+}
+
+bool parseRate(const std::string& text, double& value) {
+    std::istringstream in(text);
+    return (in >> value) && in.peek() == std::char_traits<char>::eof() && value >= 0.0;
+}
+
+std::string formatClock(int minutes) {
+    std::ostringstream out;
+    out << std::setfill('0') << std::setw(2) << minutes / 60 << ':' << std::setw(2) << minutes % 60;
+    return out.str();
+}
+
+std::string formatDays(std::uint8_t mask) {
+    if (mask == EVERY_DAY) {
+        return "daily";
+    }
+    if (mask == WEEKDAYS) {
+        return "weekdays";
+    }
+    if (mask == WEEKENDS) {
+        return "weekends";
+    }
+    std::string days;
+    for (int day = 0; day < 7; ++day) {
+        if (mask & (1u << day)) {
+            days += days.empty() ? "" : ",";
+            days += char('0' + day);
+        }
+    }
+    return days;
+}
+
+bool covers(const TariffWindow& window, int weekday, int minute) {
+    bool today = (window.dayMask & (1u << weekday)) != 0;
+    bool yesterday = (window.dayMask & (1u << ((weekday + 6) % 7))) != 0;
+    if (window.startMinute == window.endMinute) {
+        return today;
+    }
+    if (window.startMinute < window.endMinute) {
+        return today && minute >= window.startMinute && minute < window.endMinute;
+    }
+    return (today && minute >= window.startMinute) || (yesterday && minute < window.endMinute);
+}
+
+} // namespace
+
+double Tariff::rateAt(int weekday, int minute) const {
+    double rate = baseRate;
+    for (const auto& window : windows) {
+        if (covers(window, weekday, minute)) {
+            rate = window.rate;
+        }
+    }
+    return rate;
+}
+
+double Tariff::tierCost(double energy) const {
+    double cost = 0.0;
+    for (size_t k = 0; k < tiers.size() && energy > tiers[k].fromEnergy; ++k) {
+        double upTo = k + 1 < tiers.size() ? std::min(energy, tiers[k + 1].fromEnergy) : energy;
+        cost += tiers[k].surcharge * (upTo - tiers[k].fromEnergy);
+    }
+    return cost;
+}
+
+bool parseTariff(std::istream& in, Tariff& tariff, std::string& error) {
+    Tariff parsed;
+    std::string line;
+    for (size_t lineNumber = 1; std::getline(in, line); ++lineNumber) {
+        size_t comment = line.find('#');
+        if (comment != std::string::npos) {
+            line.erase(comment);
+        }
+        std::istringstream fields(line);
+        std::vector<std::string> words;
+        std::string word;
+        while (fields >> word) {
+            words.push_back(word);
+        }
+        if (words.empty()) {
+            continue;
+        }
+        const std::string& keyword = words[0];
+        bool valid;
+        if (keyword == "rate") {
+            valid = words.size() == 2 && parseRate(words[1], parsed.baseRate);
+        } else if (keyword == "window") {
+            TariffWindow window;
+            window.dayMask = EVERY_DAY;
+            valid = (words.size() == 5 || words.size() == 6) &&
+                    parseClockText(words[2], window.startMinute) && parseClockText(words[3], window.endMinute) &&
+                    parseRate(words.back(), window.rate);
+            if (valid && words.size() == 6) {
+                const std::string& days = words[4];
+                if (days == "weekdays") {
+                    window.dayMask = WEEKDAYS;
+                } else if (days == "weekends") {
+                    window.dayMask = WEEKENDS;
+                } else if (days != "daily") {
+                    valid = parseDayMask(days, window.dayMask);
+                }
+            }
+            window.name = words[1];
+            parsed.windows.push_back(window);
+        } else if (keyword == "cap") {
+            valid = words.size() == 2 && parseRate(words[1], parsed.powerCap);
+        } else if (keyword == "tier") {
+            TariffTier tier;
+            valid = words.size() == 3 && parseRate(words[1], tier.fromEnergy) && parseRate(words[2], tier.surcharge);
+            parsed.tiers.push_back(tier);
+        } else {
+            valid = false;
+        }
+        if (!valid) {
+            error = "line " + std::to_string(lineNumber) + ": cannot read \"" + line + "\"";
+            return false;
+        }
+    }
+    std::stable_sort(parsed.tiers.begin(), parsed.tiers.end(), [](const TariffTier& a, const TariffTier& b) {
+        return a.fromEnergy < b.fromEnergy;
+    });
+    tariff = parsed;
+    return true;
+}
+
+bool loadTariff(const std::string& path, Tariff& tariff, std::string& error) {
+    std::ifstream file(path);
+    if (!file) {
+        error = "cannot open " + path;
+        return false;
+    }
+    return parseTariff(file, tariff, error);
+}
+
+std::string formatTariff(const Tariff& tariff) {
+    std::ostringstream out;
+    out << std::setprecision(10);
+    out << "rate " << tariff.baseRate << "\n";
+    for (const auto& window : tariff.windows) {
+        out << "window " << window.name << ' ' << formatClock(window.startMinute) << ' '
+            << formatClock(window.endMinute) << ' ' << formatDays(window.dayMask) << ' ' << window.rate << "\n";
+    }
+    for (const auto& tier : tariff.tiers) {
+        out << "tier " << tier.fromEnergy << ' ' << tier.surcharge << "\n";
+    }
+    if (tariff.powerCap > 0.0) {
+        out << "cap " << tariff.powerCap << "\n";
+    }
+    return out.str();
+}
+
+void TariffTable::compile(const Tariff& tariff, std::time_t from, std::time_t to,
+                          const std::vector<std::pair<std::time_t, double> >& monthlySurcharges) {
+    starts.clear();
+    rates.clear();
+    integrals.clear();
+
+    // Time-of-use segments, cut at every window edge of each local day
+    std::vector<int> cuts;
+    cuts.push_back(0);
+    for (const auto& window : tariff.windows) {
+        cuts.push_back(window.startMinute);
+        cuts.push_back(window.endMinute);
+    }
+    std::sort(cuts.begin(), cuts.end());
+    cuts.erase(std::unique(cuts.begin(), cuts.end()), cuts.end());
+    std::time_t firstDay = startOfDay(from);
+    for (int offset = 0; ; ++offset) {
+        int weekday;
+        std::time_t day = localTimeOnDay(firstDay, offset, 0, &weekday);
+        if (offset > 0 && day >= to) {
+            break;
+        }
+        for (int minute : cuts) {
+            append(minute == 0 ? day : localTimeOnDay(firstDay, offset, minute, nullptr),
+                   tariff.rateAt(weekday, minute));
+        }
+        if (tariff.windows.empty()) {
+            break;
+        }
+    }
+    if (monthlySurcharges.empty()) {
+        return;
+    }
+
+    // Add each month's surcharge, cutting the segments at month starts
+    std::vector<std::time_t> segmentStarts;
+    std::vector<double> segmentRates;
+    segmentStarts.swap(starts);
+    segmentRates.swap(rates);
+    integrals.clear();
+    size_t segment = 0;
+    size_t month = 0;
+    double surcharge = 0.0;
+    while (segment < segmentStarts.size() || month < monthlySurcharges.size()) {
+        bool monthFirst = segment == segmentStarts.size() ||
+                          (month < monthlySurcharges.size() && monthlySurcharges[month].first <= segmentStarts[segment]);
+        std::time_t cut;
+        if (monthFirst) {
+            cut = monthlySurcharges[month].first;
+            surcharge = monthlySurcharges[month].second;
+            ++month;
+        } else {
+            cut = segmentStarts[segment];
+            ++segment;
+        }
+        if (segment == 0) {
+            continue;   // month starting before the first segment: only its surcharge is needed
+        }
+        append(std::max(cut, segmentStarts[0]), segmentRates[segment - 1] + surcharge);
+    }
+}
+
+size_t TariffTable::find(std::time_t t) const {
+    size_t segment = static_cast<size_t>(std::upper_bound(starts.begin(), starts.end(), t) - starts.begin());
+    return segment == 0 ? 0 : segment - 1;
+}
+
+void TariffTable::append(std::time_t start, double rate) {
+    if (!starts.empty() && start <= starts.back()) {
+        // Same instant (or a DST repeat): the later rate wins
+        rates.back() = rate;
+        return;
+    }
+    if (!rates.empty() && rates.back() == rate) {
+        return;
+    }
+    integrals.push_back(starts.empty() ? 0.0 : integrals.back() + rates.back() * static_cast<double>(start - starts.back()));
+    starts.push_back(start);
+    rates.push_back(rate);
+}
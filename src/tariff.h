@@ -0,0 +1,132 @@
+//Project name : Smart Home Automation
+//file name : tariff.h
+
+#ifndef SMART_HOME_TARIFF_H
+#define SMART_HOME_TARIFF_H
+
+#include <cstdint>
+#include <ctime>
+#include <istream>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Rate that applies between two local times of day on the weekdays selected
+// by 'dayMask' (bit 0 = Sunday). An end earlier than the start runs past
+// midnight; equal times cover the whole day.
+struct TariffWindow {
+    std::string name;
+    int startMinute;
+    int endMinute;
+    std::uint8_t dayMask;
+    double rate;             // Fils per kWh
+};
+
+// Surcharge per kWh on the house's consumption in a calendar month beyond
+// 'fromEnergy', up to the next tier
+struct TariffTier {
+    double fromEnergy;       // kWh
+    double surcharge;        // Fils per kWh
+};
+
+// Electricity supply contract: a base rate, time-of-use windows (later
+// windows win where they overlap), monthly consumption tiers and the most
+// power the scheduled devices may draw at once
+struct Tariff {
+    double baseRate;         // Fils per kWh
+    std::vector<TariffWindow> windows;
+    std::vector<TariffTier> tiers;   // sorted by fromEnergy
+    double powerCap;         // watts; 0 for no limit
+
+    Tariff() : baseRate(0.009), powerCap(0.0) {}
+
+    bool flat() const { return windows.empty() && tiers.empty(); }
+
+    // Time-of-use rate at a local time, without tier surcharges
+    double rateAt(int weekday, int minute) const;
+
+    // Tier surcharges due on 'energy' kWh consumed in one month
+    double tierCost(double energy) const;
+};
+
+// Read a tariff in the text format, one setting per line, '#' starts a comment:
+//   rate <Fils per kWh>
+//   window <name> <HH:MM> <HH:MM> [daily|weekdays|weekends|<days>] <Fils per kWh>
+//   tier <kWh per month> <surcharge Fils per kWh>
+//   cap <watts>
+// Returns false with the offending line in 'error'.
+bool parseTariff(std::istream& in, Tariff& tariff, std::string& error);
+
+// parseTariff on a file
+bool loadTariff(const std::string& path, Tariff& tariff, std::string& error);
+
+// The tariff in the format read by parseTariff
+std::string formatTariff(const Tariff& tariff);
+
+// A tariff compiled for a span of time into a sorted table of UTC instants
+// where the rate changes, with the running integral of the rate at each one.
+// The cost of any interval is then the difference of two table lookups, no
+// matter how many windows or months it crosses.
+class TariffTable {
+public:
+    // Compile 'tariff' for [from, to). 'monthlySurcharges' holds
+    // (local month start, surcharge per kWh) pairs in order and adds to every
+    // rate within that month.
+    void compile(const Tariff& tariff, std::time_t from, std::time_t to,
+                 const std::vector<std::pair<std::time_t, double> >& monthlySurcharges);
+
+    size_t size() const { return starts.size(); }
+
+    // Integral of the rate over [from, to), in Fils per kWh times seconds.
+    // Times outside the compiled span use the first or last rate.
+    double rateSeconds(std::time_t from, std::time_t to) const {
+        return integral(to, find(to)) - integral(from, find(from));
+    }
+
+    // Lookups from a remembered position, for times that mostly move forward
+    // (records of one device, history rows sorted by ON time)
+    class Cursor {
+    public:
+        explicit Cursor(const TariffTable& t) : table(&t), segment(0) {}
+
+        double rateSeconds(std::time_t from, std::time_t to) {
+            double start = at(from);
+            return at(to) - start;
+        }
+
+    private:
+        const TariffTable* table;
+        size_t segment;
+
+        // Stay in the current segment or step to the next one; anything
+        // further away falls back to a binary search
+        double at(std::time_t t) {
+            const std::vector<std::time_t>& starts = table->starts;
+            size_t next = segment + 1;
+            bool before = t < starts[segment] && segment > 0;
+            bool after = next < starts.size() && t >= starts[next];
+            if (after && (next + 1 == starts.size() || t < starts[next + 1])) {
+                segment = next;
+            } else if (before || after) {
+                segment = table->find(t);
+            }
+            return table->integral(t, segment);
+        }
+    };
+
+private:
+    std::vector<std::time_t> starts;   // first instant of each segment
+    std::vector<double> rates;         // Fils per kWh within each segment
+    std::vector<double> integrals;     // integral of the rate up to each start
+
+    // Segment containing 't'; the first one for earlier times
+    size_t find(std::time_t t) const;
+
+    double integral(std::time_t t, size_t segment) const {
+        return integrals[segment] + rates[segment] * static_cast<double>(t - starts[segment]);
+    }
+
+    void append(std::time_t start, double rate);
+};
+
+#endif // SMART_HOME_TARIFF_H
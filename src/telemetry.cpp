@@ -0,0 +1,337 @@
+//Project name : Smart Home Automation
+//file name : telemetry.cpp
+
+#include "telemetry.h"
+
+#include <cstdlib>
+#include <cstring>
+
+#include "history_store.h"
+
+const std::uint32_t TelemetryStore::BUFFER_SAMPLES;
+const std::int64_t TelemetryStore::MAX_SAMPLE_GAP;
+const std::uint32_t TraceReader::MAX_CHANNELS;
+const size_t TraceReader::BUFFER_BYTES;
+
+namespace {
+
+const size_t BATCH_HEADER_SIZE = 2 * sizeof(std::uint32_t);
+
+bool parseInt64(const char* begin, const char* end, std::int64_t& value) {
+    bool negative = begin < end && *begin == '-';
+    const char* p = negative ? begin + 1 : begin;
+    if (p == end || end - p > 18) {
+        return false;
+    }
+    std::int64_t result = 0;
+    for (; p < end; ++p) {
+        if (*p < '0' || *p > '9') {
+            return false;
+        }
+        result = result * 10 + (*p - '0');
+    }
+    value = negative ? -result : result;
+    return true;
+}
+
+bool parseChannel(const char* begin, const char* end, std::uint32_t& channel) {
+    std::int64_t value;
+    if (!parseInt64(begin, end, value) || value < 0 || value >= TraceReader::MAX_CHANNELS) {
+        return false;
+    }
+    channel = static_cast<std::uint32_t>(value);
+    return true;
+}
+
+} // namespace
+
+bool TelemetryStore::open(const std::string& filePath) {
+    close();
+    path = filePath;
+    MappedFile existing;
+    if (existing.open(path)) {
+        const char* data = existing.data();
+        size_t size = existing.size();
+        size_t offset = 0;
+        while (size - offset >= BATCH_HEADER_SIZE) {
+            std::uint32_t header[2];
+            std::memcpy(header, data + offset, sizeof(header));
+            size_t count = header[1];
+            size_t batchSize = BATCH_HEADER_SIZE + count * (sizeof(std::int64_t) + sizeof(double));
+            if (count == 0 || count > BUFFER_SAMPLES || size - offset < batchSize) {
+                break;
+            }
+            const char* times = data + offset + BATCH_HEADER_SIZE;
+            const char* watts = times + count * sizeof(std::int64_t);
+            // Samples up to the meter's last one are already in the snapshot
+            for (size_t i = 0; header[0] < registry->size() && i < count; ++i) {
+                std::int64_t time;
+                double value;
+                std::memcpy(&time, times + i * sizeof(time), sizeof(time));
+                std::memcpy(&value, watts + i * sizeof(value), sizeof(value));
+                if (!registry->isMetered(header[0]) || time > meters[header[0]].lastTime) {
+                    integrate(header[0], time, value);
+                    ++stored;
+                }
+            }
+            offset += batchSize;
+        }
+        if (offset < size) {
+            // Drop a torn tail so new batches are appended after intact data
+#if defined(__unix__) || defined(__APPLE__)
+            existing.close();
+            if (::truncate(path.c_str(), static_cast<off_t>(offset)) != 0) {
+                return false;
+            }
+#else
+            std::string intact(data, offset);
+            existing.close();
+            std::FILE* rewrite = std::fopen(path.c_str(), "wb");
+            if (!rewrite || std::fwrite(intact.data(), 1, intact.size(), rewrite) != intact.size()) {
+                if (rewrite) {
+                    std::fclose(rewrite);
+                }
+                return false;
+            }
+            std::fclose(rewrite);
+#endif
+        }
+    }
+    file = std::fopen(path.c_str(), "ab");
+    if (!file) {
+        return false;
+    }
+    std::setvbuf(file, nullptr, _IOFBF, 1 << 16);
+    return true;
+}
+
+void TelemetryStore::truncate() {
+    if (!file) {
+        return;
+    }
+    flush();
+    std::fclose(file);
+    file = std::fopen(path.c_str(), "wb");
+    if (file) {
+        std::setvbuf(file, nullptr, _IOFBF, 1 << 16);
+    }
+}
+
+void TelemetryStore::write(ByteWriter& out) const {
+    out.put(stored);
+    std::uint32_t count = 0;
+    for (size_t id = 0; id < meters.size(); ++id) {
+        count += registry->isMetered(id) ? 1 : 0;
+    }
+    out.put(count);
+    for (size_t id = 0; id < meters.size(); ++id) {
+        if (registry->isMetered(id)) {
+            out.put(static_cast<std::uint32_t>(id));
+            out.put(registry->meteredEnergy[id]);
+            out.put(meters[id].lastTime);
+            out.put(meters[id].lastWatts);
+        }
+    }
+}
+
+bool TelemetryStore::read(ByteReader& in) {
+    std::uint32_t count;
+    if (!in.get(stored) || !in.get(count)) {
+        return false;
+    }
+    meters.resize(registry->size());
+    for (std::uint32_t i = 0; i < count; ++i) {
+        std::uint32_t id;
+        double energy;
+        if (!in.get(id) || id >= registry->size() || !in.get(energy) || !(energy >= 0.0)
+            || !in.get(meters[id].lastTime) || !in.get(meters[id].lastWatts)) {
+            return false;
+        }
+        registry->meteredEnergy[id] = energy;
+    }
+    return true;
+}
+
+void TelemetryStore::close() {
+    if (file) {
+        flush();
+        std::fclose(file);
+        file = nullptr;
+    }
+}
+
+bool TelemetryStore::record(size_t deviceId, std::int64_t time, double watts) {
+    if (deviceId >= registry->size() || !(watts >= 0.0 && watts < 1e12)) {
+        return false;
+    }
+    if (registry->isMetered(deviceId) && time <= meters[deviceId].lastTime) {
+        return false;
+    }
+    integrate(deviceId, time, watts);
+    if (!file) {
+        return true;
+    }
+    Meter& meter = meters[deviceId];
+    if (!meter.times) {
+        meter.times.reset(new std::int64_t[BUFFER_SAMPLES]);
+        meter.watts.reset(new double[BUFFER_SAMPLES]);
+    }
+    meter.times[meter.buffered] = time;
+    meter.watts[meter.buffered] = watts;
+    ++pending;
+    if (++meter.buffered == BUFFER_SAMPLES) {
+        writeBatch(deviceId);
+    }
+    return true;
+}
+
+bool TelemetryStore::flush() {
+    if (!file) {
+        return false;
+    }
+    bool written = true;
+    for (size_t id = 0; id < meters.size(); ++id) {
+        if (meters[id].buffered > 0) {
+            written = writeBatch(id) && written;
+        }
+    }
+    return std::fflush(file) == 0 && written;
+}
+
+void TelemetryStore::integrate(size_t deviceId, std::int64_t time, double watts) {
+    if (meters.size() <= deviceId) {
+        meters.resize(registry->size());
+    }
+    Meter& meter = meters[deviceId];
+    double& energy = registry->meteredEnergy[deviceId];
+    if (energy < 0.0) {
+        energy = 0.0;
+    } else if (time - meter.lastTime <= MAX_SAMPLE_GAP) {
+        double seconds = static_cast<double>(time - meter.lastTime);
+        energy += ((meter.lastWatts + watts) / 2.0 / 1000.0) * (seconds / 3600.0);
+    }
+    meter.lastTime = time;
+    meter.lastWatts = watts;
+}
+
+// Append the device's buffered samples as one batch. The buffer is emptied
+// even if the write fails; the samples stay counted in the device's energy.
+bool TelemetryStore::writeBatch(size_t deviceId) {
+    Meter& meter = meters[deviceId];
+    std::uint32_t header[2] = { static_cast<std::uint32_t>(deviceId), meter.buffered };
+    bool written = std::fwrite(header, sizeof(header), 1, file) == 1
+        && std::fwrite(meter.times.get(), sizeof(std::int64_t), meter.buffered, file) == meter.buffered
+        && std::fwrite(meter.watts.get(), sizeof(double), meter.buffered, file) == meter.buffered;
+    stored += meter.buffered;
+    pending -= meter.buffered;
+    meter.buffered = 0;
+    return written;
+}
+
+bool TraceReader::next(std::vector<Meter>& meters, std::vector<Sample>& samples, std::string& error) {
+    meters.clear();
+    samples.clear();
+    error.clear();
+    char* data = buffer.data();
+    while (!finished || kept > 0) {
+        size_t size = kept;
+        if (!finished) {
+            size_t wanted = BUFFER_BYTES - kept;
+            size_t read = std::fread(data + kept, 1, wanted, file);
+            size += read;
+            finished = read < wanted;
+        }
+        data[size] = '\0';
+
+        // Whole lines end at the last newline; at the end of the input the
+        // rest is a line too
+        size_t end = size;
+        if (!finished) {
+            while (end > 0 && data[end - 1] != '\n') {
+                --end;
+            }
+            if (end == 0) {
+                error = "line " + std::to_string(lineNumber + 1) + " is too long";
+                return false;
+            }
+        }
+        const char* line = data;
+        const char* stop = data + end;
+        while (line < stop) {
+            const char* newline = static_cast<const char*>(std::memchr(line, '\n', static_cast<size_t>(stop - line)));
+            const char* lineEnd = newline ? newline : stop;
+            ++lineNumber;
+            if (!parseLine(line, lineEnd, meters, samples, error)) {
+                error = "line " + std::to_string(lineNumber) + ": " + error;
+                return false;
+            }
+            line = newline ? newline + 1 : stop;
+        }
+        kept = size - end;
+        std::memmove(data, data + end, kept);
+        if (!meters.empty() || !samples.empty()) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool TraceReader::parseLine(const char* begin, const char* end, std::vector<Meter>& meters,
+                            std::vector<Sample>& samples, std::string& error) {
+    const char* comment = static_cast<const char*>(std::memchr(begin, '#', static_cast<size_t>(end - begin)));
+    if (comment) {
+        end = comment;
+    }
+    const size_t MAX_WORDS = 5;
+    const char* words[MAX_WORDS];
+    const char* wordEnds[MAX_WORDS];
+    size_t count = 0;
+    for (const char* p = begin; p < end && count < MAX_WORDS; ) {
+        while (p < end && (*p == ' ' || *p == '\t' || *p == '\r')) {
+            ++p;
+        }
+        if (p == end) {
+            break;
+        }
+        words[count] = p;
+        while (p < end && *p != ' ' && *p != '\t' && *p != '\r') {
+            ++p;
+        }
+        wordEnds[count++] = p;
+    }
+    if (count == 0) {
+        return true;
+    }
+    if (wordEnds[0] - words[0] == 5 && std::memcmp(words[0], "meter", 5) == 0) {
+        Meter meter;
+        if (count != 4 || !parseChannel(words[1], wordEnds[1], meter.channel)) {
+            error = "usage: meter <channel> <room> <device>";
+            return false;
+        }
+        if (bound.size() <= meter.channel) {
+            bound.resize(meter.channel + 1, false);
+        }
+        if (bound[meter.channel]) {
+            error = "channel " + std::to_string(meter.channel) + " is already bound";
+            return false;
+        }
+        bound[meter.channel] = true;
+        meter.room.assign(words[2], wordEnds[2]);
+        meter.device.assign(words[3], wordEnds[3]);
+        meters.push_back(meter);
+        return true;
+    }
+    Sample sample;
+    char* number;
+    if (count != 3 || !parseInt64(words[0], wordEnds[0], sample.time) || !parseChannel(words[1], wordEnds[1], sample.channel)
+        || (sample.watts = std::strtod(words[2], &number), number != wordEnds[2])) {
+        error = "expected <unix time> <channel> <watts>";
+        return false;
+    }
+    if (sample.channel >= bound.size() || !bound[sample.channel]) {
+        error = "channel " + std::to_string(sample.channel) + " has no meter line";
+        return false;
+    }
+    samples.push_back(sample);
+    return true;
+}
@@ -0,0 +1,134 @@
+//Project name : Smart Home Automation
+//file name : telemetry.h
+
+#ifndef SMART_HOME_TELEMETRY_H
+#define SMART_HOME_TELEMETRY_H
+
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "device_registry.h"
+#include "journal.h"
+
+// Metered power of the devices. Samples are folded into the device's
+// registry.meteredEnergy as they arrive (trapezoids between consecutive
+// samples, nothing across gaps longer than MAX_SAMPLE_GAP), so reading the
+// energy never rescans them. They are also kept in a fixed buffer per device
+// and appended to the sample file a full buffer at a time, as batches of
+//   u32 deviceId | u32 count | i64 times[count] | f64 watts[count]
+// Recording a sample never allocates once its device's buffer exists. The
+// snapshot keeps each meter's energy and last sample, so the file only has
+// to hold the samples recorded since the last snapshot.
+class TelemetryStore {
+public:
+    static const std::uint32_t BUFFER_SAMPLES = 512;     // samples per device between writes
+    static const std::int64_t MAX_SAMPLE_GAP = 15 * 60;  // seconds; a longer gap means the meter was off
+
+    explicit TelemetryStore(DeviceRegistry& r) : registry(&r), file(nullptr), stored(0), pending(0) {}
+    ~TelemetryStore() { close(); }
+
+    TelemetryStore(const TelemetryStore&) = delete;
+    TelemetryStore& operator=(const TelemetryStore&) = delete;
+
+    // Fold the samples of the file at 'path' that are later than each
+    // meter's last sample into the energy of the registry's devices, then
+    // keep appending to it. A torn last batch is cut off. Returns false if
+    // the file cannot be opened for appending.
+    bool open(const std::string& path);
+
+    // Empty the sample file, once a snapshot holds everything in it
+    void truncate();
+
+    // Write the buffered samples, then close the file
+    void close();
+
+    // Add a sample. Returns false, ignoring it, unless it is later than the
+    // device's last sample and 'watts' is a valid reading. While the file is
+    // closed samples are integrated but not kept.
+    bool record(size_t deviceId, std::int64_t time, double watts);
+
+    // Write every buffered sample
+    bool flush();
+
+    // Each meter's energy and last sample, and the sample count
+    void write(ByteWriter& out) const;
+
+    // Read what write() wrote, after the registry's devices were added
+    bool read(ByteReader& in);
+
+    // Samples written to the file, and samples waiting in buffers
+    std::uint64_t storedSamples() const { return stored; }
+    std::uint64_t bufferedSamples() const { return pending; }
+
+private:
+    // Last sample and write buffer of one device; the buffer is kept as the
+    // two columns of a batch
+    struct Meter {
+        std::int64_t lastTime;
+        double lastWatts;
+        std::uint32_t buffered;
+        std::unique_ptr<std::int64_t[]> times;
+        std::unique_ptr<double[]> watts;
+
+        Meter() : lastTime(0), lastWatts(0.0), buffered(0) {}
+    };
+
+    DeviceRegistry* registry;
+    std::vector<Meter> meters;   // indexed by device id
+    std::string path;
+    std::FILE* file;
+    std::uint64_t stored;
+    std::uint64_t pending;
+
+    void integrate(size_t deviceId, std::int64_t time, double watts);
+    bool writeBatch(size_t deviceId);
+};
+
+// Reader of recorded telemetry traces, text lines of
+//   meter <channel> <room> <device>     bind a channel number to a device
+//   <unix time> <channel> <watts>       one sample
+// where '#' starts a comment. The input is parsed a buffer at a time, so
+// replaying a trace holds neither the file nor a string per line in memory.
+class TraceReader {
+public:
+    static const std::uint32_t MAX_CHANNELS = 1 << 16;
+
+    struct Meter {
+        std::uint32_t channel;
+        std::string room;
+        std::string device;
+    };
+
+    struct Sample {
+        std::uint32_t channel;
+        std::int64_t time;
+        double watts;
+    };
+
+    explicit TraceReader(std::FILE* in) : file(in), buffer(BUFFER_BYTES + 1), kept(0), lineNumber(0), finished(false) {}
+
+    // Parse the next buffer of lines into 'meters' and 'samples' (both
+    // cleared first). Meter lines only bind channels not bound before, so
+    // handling a call's meters ahead of its samples keeps the trace order.
+    // Returns false at the end of the input, or with a message in 'error'
+    // on a malformed line.
+    bool next(std::vector<Meter>& meters, std::vector<Sample>& samples, std::string& error);
+
+private:
+    static const size_t BUFFER_BYTES = 1 << 16;
+
+    std::FILE* file;
+    std::vector<char> buffer;      // one extra byte for a terminating NUL
+    size_t kept;                   // bytes of an incomplete line carried over
+    size_t lineNumber;
+    bool finished;
+    std::vector<bool> bound;       // channels named by a meter line
+
+    bool parseLine(const char* begin, const char* end, std::vector<Meter>& meters,
+                   std::vector<Sample>& samples, std::string& error);
+};
+
+#endif // SMART_HOME_TELEMETRY_H
@@ -0,0 +1,35 @@
+//Project name : Smart Home Automation
+//file name : time_util.cpp
+
+#include "time_util.h"
+
+#include <chrono>
+
+std::tm localTime(std::time_t t) {
+    std::tm result;
+#ifdef _WIN32
+    localtime_s(&result, &t);
+#else
+    localtime_r(&t, &result);
+#endif
+    return result;
+}
+
+std::string currentDateTime() {
+    auto now = std::chrono::system_clock::now();
+    std::string result;
+    appendDateTime(result, std::chrono::system_clock::to_time_t(now));
+    return result;
+}
+
+void appendDateTime(std::string& out, std::time_t t) {
+    thread_local std::time_t formattedTime = -1;
+    thread_local char formatted[100];
+    thread_local size_t length = 0;
+    if (t != formattedTime) {
+        std::tm tm_local = localTime(t);
+        length = std::strftime(formatted, sizeof(formatted), "%c", &tm_local);
+        formattedTime = t;
+    }
+    out.append(formatted, length);
+}
@@ -0,0 +1,21 @@
+//Project name : Smart Home Automation
+//file name : time_util.h
+
+#ifndef SMART_HOME_TIME_UTIL_H
+#define SMART_HOME_TIME_UTIL_H
+
+#include <ctime>
+#include <string>
+
+// Thread-safe conversion to local time (the scheduler thread also needs it)
+std::tm localTime(std::time_t t);
+
+// Utility function to get current date and time as a string
+std::string currentDateTime();
+
+// Append 't' as local date and time in the locale's format. The text is
+// formatted once per second and thread, so redrawing screens does not go
+// through localtime and strftime each time.
+void appendDateTime(std::string& out, std::time_t t);
+
+#endif // SMART_HOME_TIME_UTIL_H
@@ -0,0 +1,279 @@
+//Project name : Smart Home Automation
+//file name : trend_index.cpp
+
+#include "trend_index.h"
+
+#include <algorithm>
+#include <cmath>
+
+const std::uint32_t IndexedHeap::ABSENT;
+const std::uint32_t TrendIndex::NOT_ON;
+const double TrendIndex::MILLIWATT_SECONDS_PER_KWH = 3600.0 * 1000.0 * 1000.0;
+
+namespace {
+
+// Keep the 'k' largest candidates, highest first; ties go to the lower id
+std::vector<TrendEntry> rankCandidates(std::vector<TrendEntry> candidates, size_t k) {
+    size_t count = std::min(k, candidates.size());
+    std::partial_sort(candidates.begin(), candidates.begin() + count, candidates.end(),
+        [](const TrendEntry& a, const TrendEntry& b) {
+            return a.value > b.value || (a.value == b.value && a.id < b.id);
+        });
+    candidates.resize(count);
+    return candidates;
+}
+
+// The heap's top 'k' as candidates
+std::vector<TrendEntry> heapCandidates(const IndexedHeap& heap, size_t k) {
+    std::vector<std::uint32_t> ids;
+    std::vector<double> keys;
+    heap.top(k, ids, keys);
+    std::vector<TrendEntry> candidates(ids.size());
+    for (size_t i = 0; i < ids.size(); ++i) {
+        candidates[i].id = ids[i];
+        candidates[i].value = keys[i];
+    }
+    return candidates;
+}
+
+} // namespace
+
+void IndexedHeap::set(std::uint32_t id, double key) {
+    reserveIds(size_t(id) + 1);
+    if (positions[id] == ABSENT) {
+        heap.push_back(Entry());
+        place(heap.size() - 1, Entry{key, id});
+        siftUp(heap.size() - 1);
+        return;
+    }
+    size_t position = positions[id];
+    bool raised = key > heap[position].key;
+    heap[position].key = key;
+    if (raised) {
+        siftUp(position);
+    } else {
+        siftDown(position);
+    }
+}
+
+void IndexedHeap::erase(std::uint32_t id) {
+    if (!contains(id)) {
+        return;
+    }
+    size_t position = positions[id];
+    positions[id] = ABSENT;
+    Entry last = heap.back();
+    heap.pop_back();
+    if (position < heap.size()) {
+        place(position, last);
+        siftUp(position);
+        siftDown(positions[last.id]);
+    }
+}
+
+void IndexedHeap::clear() {
+    heap.clear();
+    positions.clear();
+}
+
+void IndexedHeap::top(size_t k, std::vector<std::uint32_t>& ids, std::vector<double>& keys) const {
+    // Only the children of entries already taken can come next
+    std::vector<size_t> frontier;
+    auto below = [this](size_t a, size_t b) { return above(heap[b], heap[a]); };
+    if (!heap.empty()) {
+        frontier.push_back(0);
+    }
+    for (size_t taken = 0; taken < k && !frontier.empty(); ++taken) {
+        std::pop_heap(frontier.begin(), frontier.end(), below);
+        size_t position = frontier.back();
+        frontier.pop_back();
+        ids.push_back(heap[position].id);
+        keys.push_back(heap[position].key);
+        for (size_t child = 2 * position + 1; child <= 2 * position + 2 && child < heap.size(); ++child) {
+            frontier.push_back(child);
+            std::push_heap(frontier.begin(), frontier.end(), below);
+        }
+    }
+}
+
+void IndexedHeap::siftUp(size_t position) {
+    Entry entry = heap[position];
+    while (position > 0) {
+        size_t parent = (position - 1) / 2;
+        if (!above(entry, heap[parent])) {
+            break;
+        }
+        place(position, heap[parent]);
+        position = parent;
+    }
+    place(position, entry);
+}
+
+void IndexedHeap::siftDown(size_t position) {
+    Entry entry = heap[position];
+    for (;;) {
+        size_t child = 2 * position + 1;
+        if (child >= heap.size()) {
+            break;
+        }
+        if (child + 1 < heap.size() && above(heap[child + 1], heap[child])) {
+            ++child;
+        }
+        if (!above(heap[child], entry)) {
+            break;
+        }
+        place(position, heap[child]);
+        position = child;
+    }
+    place(position, entry);
+}
+
+void TrendIndex::addRoom() {
+    std::uint32_t room = static_cast<std::uint32_t>(rooms.size());
+    rooms.push_back(RoomTotals{0, 0, 0, 0, 0});
+    roomSlots.push_back(NOT_ON);
+    fixedRooms.set(room, 0.0);
+}
+
+void TrendIndex::addDevice(const DeviceRegistry& registry, size_t id) {
+    onSlots.resize(id + 1, NOT_ON);
+    growingKeys.resize(id + 1, 0.0);
+    deviceShares.resize(id + 1, 0);
+    growing.resize(id + 1, false);
+    update(registry, id);
+}
+
+void TrendIndex::update(const DeviceRegistry& registry, size_t id) {
+    std::uint32_t device = static_cast<std::uint32_t>(id);
+    bool on = registry.hasOpenRecord(id);
+    double closedSeconds = registry.closedActiveSeconds[id];
+    // Closed seconds less the ON time orders ON devices by active time at
+    // any 'now'; both are whole seconds, so the key is exact
+    double onKey = closedSeconds - double(registry.openOnTimes[id]);
+    if (on) {
+        idleActive.erase(device);
+        onActive.set(device, onKey);
+        if (onSlots[id] == NOT_ON) {
+            onSlots[id] = static_cast<std::uint32_t>(onDevices.size());
+            onDevices.push_back(device);
+        }
+    } else {
+        if (onSlots[id] != NOT_ON) {
+            onDevices[onSlots[id]] = onDevices.back();
+            onSlots[onDevices.back()] = onSlots[id];
+            onDevices.pop_back();
+            onSlots[id] = NOT_ON;
+        }
+        onActive.erase(device);
+        idleActive.set(device, closedSeconds);
+    }
+
+    // Take the device's old share out of its room, then put the new one in
+    std::uint32_t room = registry.roomIds[id];
+    RoomTotals& totals = rooms[room];
+    double rating = registry.powerRatings[id];
+    std::int64_t milliwatts = std::llround(rating * 1000.0);
+    if (growing[id]) {
+        totals.offset -= deviceShares[id];
+        totals.rate -= milliwatts;
+        auto group = growingByRating.find(rating);
+        group->second.erase(std::make_pair(growingKeys[id], device));
+        if (group->second.empty()) {
+            growingByRating.erase(group);
+        }
+        if (--totals.growingDevices == 0) {
+            growingRooms[roomSlots[room]] = growingRooms.back();
+            roomSlots[growingRooms.back()] = roomSlots[room];
+            growingRooms.pop_back();
+            roomSlots[room] = NOT_ON;
+        }
+    } else {
+        totals.fixed -= deviceShares[id];
+    }
+
+    // A metered device's energy only moves with its samples, and an
+    // unmetered device's only while it is ON
+    growing[id] = on && !registry.isMetered(id);
+    if (growing[id]) {
+        fixedEnergy.erase(device);
+        std::time_t onTime = registry.openOnTimes[id];
+        if (totals.growingDevices++ == 0) {
+            totals.reference = onTime;
+            roomSlots[room] = static_cast<std::uint32_t>(growingRooms.size());
+            growingRooms.push_back(room);
+        }
+        deviceShares[id] = milliwatts * (std::llround(closedSeconds) - std::int64_t(onTime - totals.reference));
+        totals.offset += deviceShares[id];
+        totals.rate += milliwatts;
+        growingKeys[id] = onKey;
+        growingByRating[rating].insert(std::make_pair(onKey, device));
+    } else {
+        double energy = registry.energyConsumed(id, 0);   // the time only matters while growing
+        fixedEnergy.set(device, energy);
+        deviceShares[id] = registry.isMetered(id) ? std::llround(energy * MILLIWATT_SECONDS_PER_KWH)
+                                                  : milliwatts * std::llround(closedSeconds);
+        totals.fixed += deviceShares[id];
+    }
+    setRoomKey(room);
+}
+
+void TrendIndex::rebuild(const DeviceRegistry& registry, size_t roomCount) {
+    idleActive.clear();
+    onActive.clear();
+    fixedEnergy.clear();
+    fixedRooms.clear();
+    growingByRating.clear();
+    onDevices.clear();
+    onSlots.assign(registry.size(), NOT_ON);
+    growingKeys.assign(registry.size(), 0.0);
+    deviceShares.assign(registry.size(), 0);
+    growing.assign(registry.size(), false);
+    rooms.clear();
+    growingRooms.clear();
+    roomSlots.clear();
+    for (size_t room = 0; room < roomCount; ++room) {
+        addRoom();
+    }
+    for (size_t id = 0; id < registry.size(); ++id) {
+        update(registry, id);
+    }
+}
+
+std::vector<TrendEntry> TrendIndex::topEnergyDevices(const DeviceRegistry& registry, std::time_t now, size_t k) const {
+    std::vector<TrendEntry> candidates = heapCandidates(fixedEnergy, k);
+    // Within one rating, energy follows the key
+    for (const auto& group : growingByRating) {
+        size_t taken = 0;
+        for (auto it = group.second.begin(); it != group.second.end() && taken < k; ++it, ++taken) {
+            candidates.push_back(TrendEntry{it->second, registry.energyConsumed(it->second, now)});
+        }
+    }
+    return rankCandidates(std::move(candidates), k);
+}
+
+std::vector<TrendEntry> TrendIndex::topActiveDevices(const DeviceRegistry& registry, std::time_t now, size_t k) const {
+    std::vector<TrendEntry> candidates = heapCandidates(idleActive, k);
+    std::vector<TrendEntry> longestOn = heapCandidates(onActive, k);
+    for (const TrendEntry& entry : longestOn) {
+        candidates.push_back(TrendEntry{entry.id, registry.totalActiveTime(entry.id, now)});
+    }
+    return rankCandidates(std::move(candidates), k);
+}
+
+std::vector<TrendEntry> TrendIndex::topEnergyRooms(const DeviceRegistry& /*registry*/, std::time_t now, size_t k) const {
+    std::vector<TrendEntry> candidates = heapCandidates(fixedRooms, k);
+    for (std::uint32_t room : growingRooms) {
+        const RoomTotals& totals = rooms[room];
+        std::int64_t energy = totals.fixed + totals.offset + totals.rate * std::int64_t(now - totals.reference);
+        candidates.push_back(TrendEntry{room, double(energy) / MILLIWATT_SECONDS_PER_KWH});
+    }
+    return rankCandidates(std::move(candidates), k);
+}
+
+void TrendIndex::setRoomKey(std::uint32_t room) {
+    if (rooms[room].growingDevices == 0) {
+        fixedRooms.set(room, double(rooms[room].fixed) / MILLIWATT_SECONDS_PER_KWH);
+    } else {
+        fixedRooms.erase(room);
+    }
+}
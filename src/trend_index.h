@@ -0,0 +1,150 @@
+//Project name : Smart Home Automation
+//file name : trend_index.h
+
+#ifndef SMART_HOME_TREND_INDEX_H
+#define SMART_HOME_TREND_INDEX_H
+
+#include <cstdint>
+#include <ctime>
+#include <map>
+#include <set>
+#include <utility>
+#include <vector>
+
+#include "device_registry.h"
+
+// Max-heap of (key, id) pairs that also knows where each id sits, so any
+// id's key can be changed or removed in O(log n). Larger keys come first,
+// and equal keys go to the lower id.
+class IndexedHeap {
+public:
+    static const std::uint32_t ABSENT = UINT32_MAX;
+
+    // Make room for ids below 'ids'
+    void reserveIds(size_t ids) {
+        if (positions.size() < ids) {
+            positions.resize(ids, ABSENT);
+        }
+    }
+
+    bool contains(std::uint32_t id) const { return id < positions.size() && positions[id] != ABSENT; }
+
+    size_t size() const { return heap.size(); }
+
+    // Insert 'id' or move it to its new key
+    void set(std::uint32_t id, double key);
+
+    void erase(std::uint32_t id);
+
+    void clear();
+
+    // Append the 'k' largest entries to 'ids' and 'keys', highest first,
+    // in O(k log k) without touching the heap
+    void top(size_t k, std::vector<std::uint32_t>& ids, std::vector<double>& keys) const;
+
+private:
+    struct Entry {
+        double key;
+        std::uint32_t id;
+    };
+
+    std::vector<Entry> heap;
+    std::vector<std::uint32_t> positions;   // indexed by id
+
+    static bool above(const Entry& a, const Entry& b) { return a.key > b.key || (a.key == b.key && a.id < b.id); }
+
+    void place(size_t position, const Entry& entry) {
+        heap[position] = entry;
+        positions[entry.id] = static_cast<std::uint32_t>(position);
+    }
+
+    void siftUp(size_t position);
+    void siftDown(size_t position);
+};
+
+// A device or room and its figure in a ranking
+struct TrendEntry {
+    size_t id;
+    double value;
+};
+
+// Rankings behind the Trends screen, kept up to date as devices switch
+// instead of being worked out by a sweep over the house. A device's active
+// time stops changing while it is OFF, and so does its energy while it is
+// OFF or metered; those figures sit in indexed heaps. While a device is ON
+// its active time is its closed seconds less its ON time plus 'now', so ON
+// devices are ranked by that ON-time-adjusted key, and growing devices of
+// the same power rating by it too. Room totals are kept in whole
+// milliwatt-seconds as a fixed part plus a growing part that rises by the
+// summed rating of the room's growing devices each second, so switching a
+// device adds or takes away its exact share. The top K of a ranking costs
+// O(K log n), plus K for each distinct rating of the growing devices and
+// one for each room with a growing device. Device figures are exactly the
+// ones aggregateUsage gives, and so is the order; room totals are rounded
+// to the milliwatt-second.
+class TrendIndex {
+public:
+    void addRoom();
+
+    // Register a new device, which is OFF and has used nothing yet
+    void addDevice(const DeviceRegistry& registry, size_t id);
+
+    // Re-rank a device after it switched, closed a record or got a metered
+    // sample. O(log n).
+    void update(const DeviceRegistry& registry, size_t id);
+
+    // Re-rank everything, after the registry was filled without update()
+    void rebuild(const DeviceRegistry& registry, size_t roomCount);
+
+    // The 'k' devices that used the most energy (kWh) by 'now'
+    std::vector<TrendEntry> topEnergyDevices(const DeviceRegistry& registry, std::time_t now, size_t k) const;
+
+    // The 'k' devices that have been ON longest (seconds) by 'now'
+    std::vector<TrendEntry> topActiveDevices(const DeviceRegistry& registry, std::time_t now, size_t k) const;
+
+    // The 'k' rooms that used the most energy (kWh) by 'now'
+    std::vector<TrendEntry> topEnergyRooms(const DeviceRegistry& registry, std::time_t now, size_t k) const;
+
+    // Devices ON, in no particular order
+    const std::vector<std::uint32_t>& devicesOn() const { return onDevices; }
+
+private:
+    // A room's energy at time t is fixed + offset + rate * (t - reference)
+    // milliwatt-seconds
+    struct RoomTotals {
+        std::int64_t fixed;         // the room's OFF and metered devices
+        std::int64_t offset;        // the growing devices at 'reference'
+        std::int64_t rate;          // summed rating of the growing devices, in milliwatts
+        std::time_t reference;      // ON time of the device that started the room growing
+        std::uint32_t growingDevices;
+    };
+
+    // Larger keys first, equal keys to the lower id
+    struct GrowingOrder {
+        bool operator()(const std::pair<double, std::uint32_t>& a, const std::pair<double, std::uint32_t>& b) const {
+            return a.first > b.first || (a.first == b.first && a.second < b.second);
+        }
+    };
+    typedef std::set<std::pair<double, std::uint32_t>, GrowingOrder> GrowingSet;
+
+    IndexedHeap idleActive;     // OFF devices by active seconds
+    IndexedHeap onActive;       // ON devices by closed seconds less ON time
+    IndexedHeap fixedEnergy;    // OFF or metered devices by energy
+    IndexedHeap fixedRooms;     // rooms without a growing device by energy
+    std::map<double, GrowingSet> growingByRating;   // growing devices by rating, keyed as in onActive
+    std::vector<std::uint32_t> onDevices;      // devices ON, in no particular order
+    std::vector<std::uint32_t> onSlots;        // index into onDevices, by device id
+    std::vector<double> growingKeys;           // each growing device's key in growingByRating
+    std::vector<std::int64_t> deviceShares;    // each device's share of its room's fixed or offset
+    std::vector<bool> growing;                 // by device id: ON and not metered
+    std::vector<RoomTotals> rooms;
+    std::vector<std::uint32_t> growingRooms;   // rooms with a growing device, in no particular order
+    std::vector<std::uint32_t> roomSlots;      // index into growingRooms, by room
+
+    static const std::uint32_t NOT_ON = UINT32_MAX;
+    static const double MILLIWATT_SECONDS_PER_KWH;
+
+    void setRoomKey(std::uint32_t room);
+};
+
+#endif // SMART_HOME_TREND_INDEX_H
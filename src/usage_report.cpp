@@ -0,0 +1,373 @@
+//Project name : Smart Home Automation
+//file name : usage_report.cpp
+
+#include "usage_report.h"
+
+#include <algorithm>
+
+#include "energy_kernel.h"
+#include "metrics.h"
+
+namespace {
+
+// Devices and rooms per aggregation chunk. Chunks are cut by index, not by
+// thread count, and their partial sums are combined in chunk order, so a
+// report comes out with the same bits however many threads worked on it.
+const size_t DEVICE_CHUNK = 16384;
+const size_t ROOM_CHUNK = 256;
+
+size_t chunkCount(size_t items, size_t chunkSize) {
+    return (items + chunkSize - 1) / chunkSize;
+}
+
+// Sums and rankings of one chunk of devices
+struct DeviceChunk {
+    double energy;
+    double activeSeconds;
+    std::vector<size_t> topEnergy;
+    std::vector<size_t> topActive;
+};
+
+} // namespace
+
+// The 'topN' largest values among the candidate indexes 'order', highest
+// first; ties keep the earlier entry. The order is total, so ranking the
+// union of per-chunk winners gives the same result as ranking everything.
+template <typename T, typename Value>
+std::vector<size_t> rankTop(const std::vector<T>& items, std::vector<size_t> order, size_t topN, Value value) {
+    size_t count = std::min(topN, order.size());
+    std::partial_sort(order.begin(), order.begin() + count, order.end(),
+        [&](size_t a, size_t b) {
+            double va = value(items[a]);
+            double vb = value(items[b]);
+            return va > vb || (va == vb && a < b);
+        });
+    order.resize(count);
+    return order;
+}
+
+// Indexes of the 'topN' largest values in items[begin, end)
+template <typename T, typename Value>
+std::vector<size_t> rankTop(const std::vector<T>& items, size_t begin, size_t end, size_t topN, Value value) {
+    std::vector<size_t> order(end - begin);
+    for (size_t i = 0; i < order.size(); ++i) {
+        order[i] = begin + i;
+    }
+    return rankTop(items, std::move(order), topN, value);
+}
+
+UsageSummary aggregateUsage(const Home& home, std::time_t now, size_t topN) {
+    SMART_HOME_TIMED(METRIC_AGGREGATE_USAGE);
+    const DeviceRegistry& registry = home.registry;
+    UsageSummary summary;
+    summary.generatedAt = now;
+    summary.totalEnergy = 0.0;
+    summary.totalActiveSeconds = 0.0;
+    summary.rooms.resize(home.rooms.size());
+
+    auto byEnergy = [](const DeviceUsage& u) { return u.energy; };
+    auto byActiveTime = [](const DeviceUsage& u) { return u.activeSeconds; };
+
+    // Per device figures, chunk sums and chunk rankings
+    size_t deviceCount = registry.size();
+    std::vector<double> activeSeconds(deviceCount);
+    std::vector<double> energy(deviceCount);
+    summary.devices.resize(deviceCount);
+    std::vector<DeviceChunk> chunks(chunkCount(deviceCount, DEVICE_CHUNK));
+    runChunks(home.reportPool, chunks.size(), [&](size_t c) {
+        size_t begin = c * DEVICE_CHUNK;
+        size_t end = std::min(begin + DEVICE_CHUNK, deviceCount);
+        deviceTotals(registry.closedActiveSeconds.data() + begin, registry.openOnTimes.data() + begin,
+                     registry.powerRatings.data() + begin, end - begin, now,
+                     activeSeconds.data() + begin, energy.data() + begin);
+        DeviceChunk& chunk = chunks[c];
+        chunk.energy = 0.0;
+        chunk.activeSeconds = 0.0;
+        for (size_t id = begin; id < end; ++id) {
+            DeviceUsage& deviceUsage = summary.devices[id];
+            deviceUsage.deviceId = id;
+            deviceUsage.roomIndex = registry.roomIds[id];
+            deviceUsage.activeSeconds = activeSeconds[id];
+            deviceUsage.energy = registry.isMetered(id) ? registry.meteredEnergy[id] : energy[id];
+            chunk.energy += deviceUsage.energy;
+            chunk.activeSeconds += deviceUsage.activeSeconds;
+        }
+        chunk.topEnergy = rankTop(summary.devices, begin, end, topN, byEnergy);
+        chunk.topActive = rankTop(summary.devices, begin, end, topN, byActiveTime);
+    });
+
+    // Room sums over each room's devices, in device id order
+    runChunks(home.reportPool, chunkCount(home.rooms.size(), ROOM_CHUNK), [&](size_t c) {
+        size_t end = std::min((c + 1) * ROOM_CHUNK, home.rooms.size());
+        for (size_t r = c * ROOM_CHUNK; r < end; ++r) {
+            RoomUsage& roomUsage = summary.rooms[r];
+            roomUsage.roomIndex = r;
+            roomUsage.energy = 0.0;
+            roomUsage.activeSeconds = 0.0;
+            for (const Device& device : home.rooms[r].devices) {
+                const DeviceUsage& deviceUsage = summary.devices[device.id()];
+                roomUsage.energy += deviceUsage.energy;
+                roomUsage.activeSeconds += deviceUsage.activeSeconds;
+            }
+        }
+    });
+
+    std::vector<size_t> energyCandidates;
+    std::vector<size_t> activeCandidates;
+    for (const DeviceChunk& chunk : chunks) {
+        summary.totalEnergy += chunk.energy;
+        summary.totalActiveSeconds += chunk.activeSeconds;
+        energyCandidates.insert(energyCandidates.end(), chunk.topEnergy.begin(), chunk.topEnergy.end());
+        activeCandidates.insert(activeCandidates.end(), chunk.topActive.begin(), chunk.topActive.end());
+    }
+    summary.topEnergyDevices = rankTop(summary.devices, std::move(energyCandidates), topN, byEnergy);
+    summary.topActiveDevices = rankTop(summary.devices, std::move(activeCandidates), topN, byActiveTime);
+    summary.topEnergyRooms = rankTop(summary.rooms, 0, summary.rooms.size(), topN,
+        [](const RoomUsage& u) { return u.energy; });
+    return summary;
+}
+
+UsageCost computeCosts(const Home& home, const UsageSummary& usage) {
+    const DeviceRegistry& registry = home.registry;
+    const Tariff& tariff = home.tariff;
+    std::time_t now = usage.generatedAt;
+    UsageCost cost;
+    cost.devices.assign(registry.size(), 0.0);
+    cost.rooms.assign(home.rooms.size(), 0.0);
+    cost.total = 0.0;
+    if (tariff.flat()) {
+        for (size_t id = 0; id < registry.size(); ++id) {
+            cost.devices[id] = usage.devices[id].energy * tariff.baseRate;
+        }
+        for (size_t r = 0; r < home.rooms.size(); ++r) {
+            cost.rooms[r] = usage.rooms[r].energy * tariff.baseRate;
+        }
+        cost.total = usage.totalEnergy * tariff.baseRate;
+        return cost;
+    }
+
+    // Span of the records to price
+    std::int64_t first = now;
+    std::int64_t last = now;
+    std::int64_t historyFirst;
+    std::int64_t historyLast;
+    if (home.history.timeRange(historyFirst, historyLast)) {
+        first = std::min(first, historyFirst);
+        last = std::max(last, historyLast);
+    }
+    for (size_t id = 0; id < registry.size(); ++id) {
+        registry.forEachClosedBlock(id, [&](const RecordArena::Block& block) {
+            first = std::min(first, block.spanBegin);
+            last = std::max(last, block.spanEnd);
+        });
+        if (registry.hasOpenRecord(id)) {
+            first = std::min<std::int64_t>(first, registry.openOnTimes[id]);
+        }
+    }
+
+    std::vector<std::pair<std::time_t, double> > surcharges;
+    if (!tariff.tiers.empty()) {
+        for (const auto& month : queryUsage(home, BUCKET_MONTH, first, last + 1, SCOPE_HOUSE, 0, now)) {
+            double surcharge = month.energy > 0.0 ? tariff.tierCost(month.energy) / month.energy : 0.0;
+            surcharges.push_back(std::make_pair(month.start, surcharge));
+        }
+    }
+    TariffTable table;
+    table.compile(tariff, first, last + 1, surcharges);
+
+    // Rate-weighted ON seconds per device: the history first, then the
+    // records in memory
+    std::vector<double> rateSeconds(registry.size(), 0.0);
+    TariffTable::Cursor historyCursor(table);
+    home.history.scanColumns(first, last + 1, [&](const std::int64_t* onTimes, const std::int64_t* offTimes,
+                                                 const std::uint32_t* deviceIds, size_t rows) {
+        for (size_t i = 0; i < rows; ++i) {
+            rateSeconds[deviceIds[i]] += historyCursor.rateSeconds(onTimes[i], offTimes[i]);
+        }
+    });
+    runChunks(home.reportPool, chunkCount(registry.size(), DEVICE_CHUNK), [&](size_t c) {
+        TariffTable::Cursor cursor(table);
+        size_t end = std::min((c + 1) * DEVICE_CHUNK, registry.size());
+        for (size_t id = c * DEVICE_CHUNK; id < end; ++id) {
+            registry.forEachRecord(id, [&](const ActivationRecord& record) {
+                rateSeconds[id] += cursor.rateSeconds(record.onTime, record.offTime == 0 ? now : record.offTime);
+            });
+            // A metered device's energy is spread evenly over its ON time;
+            // energy metered with no ON time is charged the base rate
+            double activeSeconds = usage.devices[id].activeSeconds;
+            if (!registry.isMetered(id)) {
+                cost.devices[id] = (registry.powerRatings[id] / 1000.0) * (rateSeconds[id] / 3600.0);
+            } else if (activeSeconds > 0.0) {
+                cost.devices[id] = usage.devices[id].energy * (rateSeconds[id] / activeSeconds);
+            } else {
+                cost.devices[id] = usage.devices[id].energy * tariff.baseRate;
+            }
+        }
+    });
+
+    for (size_t r = 0; r < home.rooms.size(); ++r) {
+        for (const Device& device : home.rooms[r].devices) {
+            cost.rooms[r] += cost.devices[device.id()];
+        }
+    }
+    for (double deviceCost : cost.devices) {
+        cost.total += deviceCost;
+    }
+    return cost;
+}
+
+double plannedEnergy(const Home& home, std::time_t from, std::time_t to) {
+    double totalEnergy = 0.0;
+    for (const auto& rule : home.schedules) {
+        if (!rule.active) {
+            continue;
+        }
+        double powerRating = home.registry.powerRatings[rule.deviceId];
+        forEachOccurrence(rule, from, to, [&](const ActivationRecord& occurrence) {
+            std::time_t start = std::max(occurrence.onTime, from);
+            std::time_t end = std::min(occurrence.offTime, to);
+            totalEnergy += (powerRating / 1000.0) * (difftime(end, start) / 3600.0);
+        });
+    }
+    return totalEnergy;
+}
+
+std::vector<double> activeSecondsInRange(const Home& home, std::time_t from, std::time_t to, std::time_t now) {
+    const DeviceRegistry& registry = home.registry;
+    std::vector<double> seconds(registry.size(), 0.0);
+    home.history.scanColumns(from, to, [&](const std::int64_t* onTimes, const std::int64_t* offTimes,
+                                           const std::uint32_t* deviceIds, size_t rows) {
+        accumulateClippedSeconds(onTimes, offTimes, deviceIds, rows, from, to, seconds.data());
+    });
+    runChunks(home.reportPool, chunkCount(registry.size(), DEVICE_CHUNK), [&](size_t c) {
+        size_t end = std::min((c + 1) * DEVICE_CHUNK, registry.size());
+        ActivationRecord records[RecordArena::MAX_BLOCK_RECORDS];
+        for (size_t id = c * DEVICE_CHUNK; id < end; ++id) {
+            // Blocks wholly inside or outside the range need no decoding
+            std::int64_t total = 0;
+            registry.forEachClosedBlock(id, [&](const RecordArena::Block& block) {
+                if (block.spanEnd <= from || block.spanBegin >= to) {
+                    return;
+                }
+                if (from <= block.spanBegin && block.spanEnd <= to) {
+                    total += block.seconds;
+                    return;
+                }
+                total += clippedSeconds(records, block.decode(records), from, to, now);
+            });
+            if (registry.hasOpenRecord(id)) {
+                std::time_t openStart = std::max(registry.openOnTimes[id], from);
+                std::time_t openEnd = std::min(now, to);
+                total += openEnd > openStart ? openEnd - openStart : 0;
+            }
+            seconds[id] += static_cast<double>(total);
+        }
+    });
+    return seconds;
+}
+
+std::vector<double> energyInRange(const Home& home, std::time_t from, std::time_t to, std::time_t now) {
+    const DeviceRegistry& registry = home.registry;
+    std::vector<double> energy = activeSecondsInRange(home, from, to, now);
+    for (size_t id = 0; id < energy.size(); ++id) {
+        double seconds = energy[id];
+        if (!registry.isMetered(id)) {
+            energy[id] = (registry.powerRatings[id] / 1000.0) * (seconds / 3600.0);
+        } else {
+            double activeSeconds = registry.totalActiveTime(id, now);
+            energy[id] = activeSeconds > 0.0 ? registry.meteredEnergy[id] * (seconds / activeSeconds) : 0.0;
+        }
+    }
+    return energy;
+}
+
+// Add the part of [onTime, offTime) that falls inside the buckets of 'result'
+void addToBuckets(std::vector<BucketUsage>& result, BucketSize size, std::time_t to,
+                  std::time_t onTime, std::time_t offTime, double powerRating) {
+    if (result.empty()) {
+        return;
+    }
+    std::time_t first = result.front().start;
+    splitIntoBuckets(size, std::max(onTime, first), std::min(offTime, to), [&](std::time_t start, double seconds) {
+        auto it = std::lower_bound(result.begin(), result.end(), start,
+            [](const BucketUsage& usage, std::time_t t) { return usage.start < t; });
+        if (it != result.end() && it->start == start) {
+            it->energy += (powerRating / 1000.0) * (seconds / 3600.0);
+            it->activeSeconds += seconds;
+        }
+    });
+}
+
+std::vector<BucketUsage> queryUsage(const Home& home, BucketSize size, std::time_t from, std::time_t to,
+                                    UsageScope scope, size_t id, std::time_t now) {
+    SMART_HOME_TIMED(METRIC_USAGE_QUERY);
+    const DeviceRegistry& registry = home.registry;
+    std::uint32_t scopeId = static_cast<std::uint32_t>(id);
+    std::vector<BucketUsage> result;
+    if (scope == SCOPE_DEVICE && !UsageRollup::tracksDevices(size)) {
+        result = home.rollup.query(size, from, to, SCOPE_HOUSE, 0);
+        for (auto& usage : result) {
+            usage.energy = 0.0;
+            usage.activeSeconds = 0.0;
+        }
+        double powerRating = registry.powerRatings[id];
+        home.history.scan(result.empty() ? from : result.front().start, to,
+            [&](std::int64_t onTime, std::int64_t offTime, std::uint32_t deviceId) {
+                if (deviceId == scopeId) {
+                    addToBuckets(result, size, to, static_cast<std::time_t>(onTime), static_cast<std::time_t>(offTime), powerRating);
+                }
+            });
+        registry.forEachRecord(id, [&](const ActivationRecord& record) {
+            if (record.offTime != 0) {
+                addToBuckets(result, size, to, record.onTime, record.offTime, powerRating);
+            }
+        });
+    } else {
+        result = home.rollup.query(size, from, to, scope, scopeId);
+    }
+
+    // Open records are not in the rollups yet
+    for (size_t device = 0; device < registry.size(); ++device) {
+        bool inScope = scope == SCOPE_HOUSE
+            || (scope == SCOPE_ROOM && registry.roomIds[device] == scopeId)
+            || (scope == SCOPE_DEVICE && device == id);
+        if (inScope && registry.openOnTimes[device] != 0) {
+            addToBuckets(result, size, to, registry.openOnTimes[device], now, registry.powerRatings[device]);
+        }
+    }
+    return result;
+}
+
+std::vector<Anomaly> findAnomalies(const Home& home, std::time_t now) {
+    const DeviceRegistry& registry = home.registry;
+    // Only devices ON or flagged can be reported
+    const std::vector<std::uint32_t>& on = home.trends.devicesOn();
+    const std::vector<std::uint32_t>& flagged = home.activity.flaggedDevices();
+    std::vector<std::uint32_t> candidates(on.begin(), on.end());
+    candidates.insert(candidates.end(), flagged.begin(), flagged.end());
+    std::sort(candidates.begin(), candidates.end());
+    candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
+    std::vector<Anomaly> result;
+    for (size_t id : candidates) {
+        const ActivityMonitor::DeviceActivity& device = home.activity.device(id);
+        if (registry.hasOpenRecord(id)) {
+            double seconds = difftime(now, registry.openOnTimes[id]);
+            if (seconds > device.duration.limit()) {
+                Anomaly anomaly = {id, ANOMALY_LEFT_ON, seconds, device.duration.mean, registry.openOnTimes[id]};
+                result.push_back(anomaly);
+            }
+            continue;
+        }
+        if (device.flags & ANOMALY_LONG_RUN) {
+            Anomaly anomaly = {id, ANOMALY_LONG_RUN, device.lastDuration, device.usualDuration,
+                               static_cast<std::time_t>(device.flaggedAt)};
+            result.push_back(anomaly);
+        }
+        if (device.flags & ANOMALY_HIGH_POWER) {
+            Anomaly anomaly = {id, ANOMALY_HIGH_POWER, device.lastPower, device.usualPower,
+                               static_cast<std::time_t>(device.flaggedAt)};
+            result.push_back(anomaly);
+        }
+    }
+    return result;
+}
@@ -0,0 +1,96 @@
+//Project name : Smart Home Automation
+//file name : usage_report.h
+
+#ifndef SMART_HOME_USAGE_REPORT_H
+#define SMART_HOME_USAGE_REPORT_H
+
+#include <ctime>
+#include <vector>
+
+#include "home.h"
+
+// Usage figures for a single device
+struct DeviceUsage {
+    size_t deviceId;
+    size_t roomIndex;
+    double energy;        // kWh
+    double activeSeconds;
+};
+
+// Usage figures for a single room
+struct RoomUsage {
+    size_t roomIndex;
+    double energy;        // kWh
+    double activeSeconds;
+};
+
+// Result of one aggregation pass over all devices
+struct UsageSummary {
+    std::time_t generatedAt;
+    std::vector<DeviceUsage> devices;   // indexed by device id
+    std::vector<RoomUsage> rooms;       // indexed by room
+    double totalEnergy;
+    double totalActiveSeconds;
+    // Rankings, as indexes into 'devices' / 'rooms', highest first
+    std::vector<size_t> topEnergyDevices;
+    std::vector<size_t> topActiveDevices;
+    std::vector<size_t> topEnergyRooms;
+};
+
+// Aggregate energy and active time per device, per room and house-wide in one
+// sweep over the registry columns
+UsageSummary aggregateUsage(const Home& home, std::time_t now, size_t topN);
+
+// Cost in Fils per device, per room and for the house under home.tariff
+struct UsageCost {
+    std::vector<double> devices;   // indexed by device id
+    std::vector<double> rooms;     // indexed by room
+    double total;
+};
+
+// Price the usage in 'usage' (an aggregateUsage result) under home.tariff. A
+// flat tariff prices the energy figures directly. Otherwise every record is
+// priced through a TariffTable compiled once for the span of the records,
+// with each month's tier surcharges spread evenly over that month's energy.
+// A metered device's energy is taken as drawn evenly over its ON time, so its
+// cost follows its metered energy. Caller holds home.mutex.
+UsageCost computeCosts(const Home& home, const UsageSummary& usage);
+
+// Energy the active schedules will consume within [from, to), expanding only
+// the occurrences that fall inside the window
+double plannedEnergy(const Home& home, std::time_t from, std::time_t to);
+
+// Active seconds per device within [from, to), combining the history files
+// with the records still held in memory; open records count up to 'now'
+std::vector<double> activeSecondsInRange(const Home& home, std::time_t from, std::time_t to, std::time_t now);
+
+// Energy in kWh per device within [from, to), from activeSecondsInRange. As
+// in computeCosts, a metered device's energy is taken as drawn evenly over
+// its ON time; energy metered with no ON time has no time to fall in and
+// counts for nothing. Caller holds home.mutex.
+std::vector<double> energyInRange(const Home& home, std::time_t from, std::time_t to, std::time_t now);
+
+// Energy and active time per bucket, from the bucket containing 'from' up to
+// 'to', for the whole house, one room or one device. Closed records come from
+// the rollups in O(buckets); open records are split on the fly up to 'now'.
+// Hourly figures for a single device are not rolled up and are computed from
+// the stored records instead. Caller holds home.mutex.
+std::vector<BucketUsage> queryUsage(const Home& home, BucketSize size, std::time_t from, std::time_t to,
+                                    UsageScope scope, size_t id, std::time_t now);
+
+// A device whose activity stands out from its own baseline
+struct Anomaly {
+    size_t deviceId;
+    AnomalyFlag kind;
+    double value;     // seconds ON, or average watts for ANOMALY_HIGH_POWER
+    double usual;     // the device's rolling mean of the same, before this activation
+    std::time_t at;   // when a device left on was switched ON, else the flagged OFF time
+};
+
+// Devices currently ON for longer than home.activity considers unusual, and
+// devices whose last activation it flagged, in device order. Looks only at
+// the devices ON (from home.trends) and those flagged, never at the records.
+// Caller holds home.mutex.
+std::vector<Anomaly> findAnomalies(const Home& home, std::time_t now);
+
+#endif // SMART_HOME_USAGE_REPORT_H
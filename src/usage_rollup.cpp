@@ -0,0 +1,38 @@
+//Project name : Smart Home Automation
+//file name : usage_rollup.cpp
+
+#include "usage_rollup.h"
+
+#include "time_util.h"
+
+std::time_t bucketStart(BucketSize size, std::time_t t) {
+    std::tm tm = localTime(t);
+    tm.tm_min = 0;
+    tm.tm_sec = 0;
+    if (size != BUCKET_HOUR) {
+        tm.tm_hour = 0;
+        tm.tm_isdst = -1;
+        if (size == BUCKET_MONTH) {
+            tm.tm_mday = 1;
+        }
+    }
+    return std::mktime(&tm);
+}
+
+std::time_t nextBucket(BucketSize size, std::time_t start) {
+    if (size == BUCKET_HOUR) {
+        return start + 3600;
+    }
+    std::tm tm = localTime(start);
+    tm.tm_hour = 0;
+    tm.tm_min = 0;
+    tm.tm_sec = 0;
+    tm.tm_isdst = -1;
+    if (size == BUCKET_DAY) {
+        tm.tm_mday += 1;
+    } else {
+        tm.tm_mday = 1;
+        tm.tm_mon += 1;
+    }
+    return std::mktime(&tm);
+}
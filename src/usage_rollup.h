@@ -0,0 +1,206 @@
+//Project name : Smart Home Automation
+//file name : usage_rollup.h
+
+#ifndef SMART_HOME_USAGE_ROLLUP_H
+#define SMART_HOME_USAGE_ROLLUP_H
+
+#include <algorithm>
+#include <cstdint>
+#include <ctime>
+#include <map>
+#include <unordered_map>
+#include <vector>
+
+#include "journal.h"
+
+// Bucket sizes for time-bucketed usage queries, in local time
+enum BucketSize {
+    BUCKET_HOUR = 0,
+    BUCKET_DAY = 1,
+    BUCKET_MONTH = 2
+};
+
+// What a usage query covers
+enum UsageScope {
+    SCOPE_HOUSE,
+    SCOPE_ROOM,
+    SCOPE_DEVICE
+};
+
+// Start of the bucket containing 't'
+std::time_t bucketStart(BucketSize size, std::time_t t);
+
+// Start of the bucket following the one starting at 'start'
+std::time_t nextBucket(BucketSize size, std::time_t start);
+
+// Split [onTime, offTime) exactly at bucket boundaries, calling
+// fn(bucketStart, seconds) for each bucket it touches
+template <typename Fn>
+void splitIntoBuckets(BucketSize size, std::time_t onTime, std::time_t offTime, Fn fn) {
+    if (offTime <= onTime) {
+        return;
+    }
+    std::time_t start = bucketStart(size, onTime);
+    while (start < offTime) {
+        std::time_t next = nextBucket(size, start);
+        std::time_t from = std::max(start, onTime);
+        std::time_t to = std::min(next, offTime);
+        fn(start, difftime(to, from));
+        start = next;
+    }
+}
+
+// Energy and active time accumulated in one cell of a rollup
+struct UsageCell {
+    double energy;          // kWh
+    double activeSeconds;
+
+    UsageCell() : energy(0.0), activeSeconds(0.0) {}
+};
+
+// Usage of one bucket returned by a query
+struct BucketUsage {
+    std::time_t start;
+    double energy;          // kWh
+    double activeSeconds;
+};
+
+// Rollup tables of closed records per hour, day and month, updated as each
+// record closes so queries cost O(buckets) instead of O(records). Hourly
+// buckets keep house and room totals; daily and monthly buckets also keep
+// per-device totals.
+class UsageRollup {
+public:
+    // Fold one closed record into every granularity
+    void add(std::uint32_t roomId, std::uint32_t deviceId, std::time_t onTime, std::time_t offTime, double powerRating) {
+        for (int size = BUCKET_HOUR; size <= BUCKET_MONTH; ++size) {
+            std::map<std::time_t, Bucket>& table = tables[size];
+            splitIntoBuckets(BucketSize(size), onTime, offTime, [&](std::time_t start, double seconds) {
+                double energy = (powerRating / 1000.0) * (seconds / 3600.0);
+                Bucket& bucket = table[start];
+                addTo(bucket.house, energy, seconds);
+                addTo(bucket.rooms[roomId], energy, seconds);
+                if (size != BUCKET_HOUR) {
+                    addTo(bucket.devices[deviceId], energy, seconds);
+                }
+            });
+        }
+    }
+
+    // Whether per-device figures are kept at this granularity
+    static bool tracksDevices(BucketSize size) { return size != BUCKET_HOUR; }
+
+    // One entry per bucket from the bucket containing 'from' up to 'to',
+    // including empty buckets
+    std::vector<BucketUsage> query(BucketSize size, std::time_t from, std::time_t to, UsageScope scope, std::uint32_t id) const {
+        std::vector<BucketUsage> result;
+        const std::map<std::time_t, Bucket>& table = tables[size];
+        auto it = table.lower_bound(bucketStart(size, from));
+        for (std::time_t start = bucketStart(size, from); start < to; start = nextBucket(size, start)) {
+            BucketUsage usage;
+            usage.start = start;
+            usage.energy = 0.0;
+            usage.activeSeconds = 0.0;
+            while (it != table.end() && it->first < start) {
+                ++it;
+            }
+            if (it != table.end() && it->first == start) {
+                const UsageCell* cell = find(it->second, scope, id);
+                if (cell) {
+                    usage.energy = cell->energy;
+                    usage.activeSeconds = cell->activeSeconds;
+                }
+            }
+            result.push_back(usage);
+        }
+        return result;
+    }
+
+    void write(ByteWriter& out) const {
+        for (int size = BUCKET_HOUR; size <= BUCKET_MONTH; ++size) {
+            out.put(static_cast<std::uint32_t>(tables[size].size()));
+            for (const auto& entry : tables[size]) {
+                out.put(static_cast<std::int64_t>(entry.first));
+                writeCell(out, entry.second.house);
+                writeCells(out, entry.second.rooms);
+                writeCells(out, entry.second.devices);
+            }
+        }
+    }
+
+    bool read(ByteReader& in) {
+        for (int size = BUCKET_HOUR; size <= BUCKET_MONTH; ++size) {
+            std::uint32_t count;
+            if (!in.get(count)) {
+                return false;
+            }
+            for (std::uint32_t i = 0; i < count; ++i) {
+                std::int64_t start;
+                if (!in.get(start)) {
+                    return false;
+                }
+                Bucket& bucket = tables[size][static_cast<std::time_t>(start)];
+                if (!readCell(in, bucket.house) || !readCells(in, bucket.rooms) || !readCells(in, bucket.devices)) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+private:
+    struct Bucket {
+        UsageCell house;
+        std::unordered_map<std::uint32_t, UsageCell> rooms;
+        std::unordered_map<std::uint32_t, UsageCell> devices;
+    };
+
+    std::map<std::time_t, Bucket> tables[3];
+
+    static void addTo(UsageCell& cell, double energy, double seconds) {
+        cell.energy += energy;
+        cell.activeSeconds += seconds;
+    }
+
+    static const UsageCell* find(const Bucket& bucket, UsageScope scope, std::uint32_t id) {
+        if (scope == SCOPE_HOUSE) {
+            return &bucket.house;
+        }
+        const std::unordered_map<std::uint32_t, UsageCell>& cells = scope == SCOPE_ROOM ? bucket.rooms : bucket.devices;
+        auto it = cells.find(id);
+        return it == cells.end() ? nullptr : &it->second;
+    }
+
+    static void writeCell(ByteWriter& out, const UsageCell& cell) {
+        out.put(cell.energy);
+        out.put(cell.activeSeconds);
+    }
+
+    static bool readCell(ByteReader& in, UsageCell& cell) {
+        return in.get(cell.energy) && in.get(cell.activeSeconds);
+    }
+
+    static void writeCells(ByteWriter& out, const std::unordered_map<std::uint32_t, UsageCell>& cells) {
+        out.put(static_cast<std::uint32_t>(cells.size()));
+        for (const auto& entry : cells) {
+            out.put(entry.first);
+            writeCell(out, entry.second);
+        }
+    }
+
+    static bool readCells(ByteReader& in, std::unordered_map<std::uint32_t, UsageCell>& cells) {
+        std::uint32_t count;
+        if (!in.get(count)) {
+            return false;
+        }
+        for (std::uint32_t i = 0; i < count; ++i) {
+            std::uint32_t id;
+            if (!in.get(id) || !readCell(in, cells[id])) {
+                return false;
+            }
+        }
+        return true;
+    }
+};
+
+#endif // SMART_HOME_USAGE_ROLLUP_H
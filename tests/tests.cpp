@@ -0,0 +1,352 @@
+//Project name : Smart Home Automation
+//file name : tests.cpp
+
+// Behaviour checks for the core library. Each check prints what failed and
+// the program exits with status 1 if any did; ctest runs it as one test.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "clock.h"
+#include "device_registry.h"
+#include "energy_kernel.h"
+#include "home.h"
+#include "journal.h"
+#include "load_profile.h"
+#include "report_writer.h"
+#include "simulation.h"
+#include "tariff.h"
+
+namespace {
+
+int failures = 0;
+
+#define CHECK(condition) \
+    do { \
+        if (!(condition)) { \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": check failed: " #condition "\n"; \
+            ++failures; \
+        } \
+    } while (0)
+
+// Records with short, long and negative gaps, zero and multi-day
+// durations, so the zigzag varints take one to five bytes
+std::vector<ActivationRecord> sampleRecords(size_t count, std::uint64_t seed) {
+    std::mt19937_64 random(seed);
+    std::vector<ActivationRecord> records;
+    std::time_t offTime = 1700000000;
+    for (size_t i = 0; i < count; ++i) {
+        ActivationRecord record;
+        std::time_t gap = static_cast<std::time_t>(random() % 5000000) - 1000;
+        record.onTime = offTime + gap;
+        record.offTime = record.onTime + static_cast<std::time_t>(random() % 400000);
+        records.push_back(record);
+        offTime = record.offTime;
+    }
+    return records;
+}
+
+bool sameRecord(const ActivationRecord& a, const ActivationRecord& b) {
+    return a.onTime == b.onTime && a.offTime == b.offTime;
+}
+
+void testRecordBlocksRoundTrip() {
+    std::vector<ActivationRecord> records = sampleRecords(5000, 1);
+
+    RecordArena arena;
+    std::vector<std::uint32_t> blocks(1, arena.allocate(records[0].onTime));
+    for (const ActivationRecord& record : records) {
+        if (!arena.block(blocks.back()).append(record)) {
+            blocks.push_back(arena.allocate(record.onTime));
+            CHECK(arena.block(blocks.back()).append(record));
+        }
+    }
+    CHECK(blocks.size() > 1);
+    size_t next = 0;
+    ActivationRecord decoded[RecordArena::MAX_BLOCK_RECORDS];
+    for (std::uint32_t index : blocks) {
+        const RecordArena::Block& block = arena.block(index);
+        std::int64_t seconds = 0, spanBegin = INT64_MAX, spanEnd = INT64_MIN;
+        std::uint32_t count = block.decode(decoded);
+        for (std::uint32_t i = 0; i < count; ++i, ++next) {
+            CHECK(next < records.size() && sameRecord(decoded[i], records[next]));
+            seconds += decoded[i].offTime - decoded[i].onTime;
+            spanBegin = std::min<std::int64_t>(spanBegin, decoded[i].onTime);
+            spanEnd = std::max<std::int64_t>(spanEnd, decoded[i].offTime);
+        }
+        CHECK(block.seconds == seconds && block.spanBegin == spanBegin && block.spanEnd == spanEnd);
+    }
+    CHECK(next == records.size());
+
+    // The same records through the registry, followed by an open one
+    DeviceRegistry registry;
+    registry.addDevice(0, "Lamp", 60.0);
+    for (const ActivationRecord& record : records) {
+        registry.addClosedRecord(0, record);
+    }
+    registry.openRecord(0, records.back().offTime + 10);
+    next = 0;
+    bool sawOpen = false;
+    registry.forEachRecord(0, [&](const ActivationRecord& record) {
+        if (next < records.size()) {
+            CHECK(sameRecord(record, records[next]));
+        } else {
+            sawOpen = record.offTime == 0 && record.onTime == records.back().offTime + 10;
+        }
+        ++next;
+    });
+    CHECK(next == records.size() + 1 && sawOpen);
+    CHECK(registry.recordsInMemory() == records.size() + 1);
+}
+
+void testJournalReplay() {
+    const char* path = "smart_home_test.journal";
+    std::remove(path);
+    Journal journal;
+    CHECK(journal.open(path, 41));
+    for (std::uint32_t i = 0; i < 3; ++i) {
+        ByteWriter payload;
+        payload.put(i * 7);
+        payload.putString("entry " + std::to_string(i));
+        journal.append(static_cast<std::uint8_t>(JOURNAL_SWITCH_ON + i % 2), payload);
+    }
+    journal.close();
+    std::string contents;
+    CHECK(readFile(path, contents));
+    std::remove(path);
+
+    std::vector<std::uint64_t> sequences;
+    std::vector<size_t> ends;
+    size_t intact = replayJournal(contents, [&](std::uint8_t type, std::uint64_t sequence, ByteReader& in) {
+        std::uint32_t value = 0;
+        std::string text;
+        size_t i = sequences.size();
+        CHECK(type == JOURNAL_SWITCH_ON + i % 2);
+        CHECK(in.get(value) && value == i * 7);
+        CHECK(in.getString(text) && text == "entry " + std::to_string(i));
+        sequences.push_back(sequence);
+    });
+    CHECK(intact == contents.size());
+    CHECK(sequences == std::vector<std::uint64_t>({ 42, 43, 44 }));
+
+    // Entry boundaries, from the size field of each header
+    for (size_t offset = 0; offset < contents.size();) {
+        std::uint32_t bodySize;
+        std::memcpy(&bodySize, contents.data() + offset, sizeof(bodySize));
+        offset += Journal::HEADER_SIZE + bodySize;
+        ends.push_back(offset);
+    }
+    CHECK(ends.size() == 3 && ends.back() == contents.size());
+
+    // A flipped payload byte in the second entry stops replay after the first
+    std::string corrupt = contents;
+    corrupt[ends[1] - 1] ^= 0x20;
+    size_t replayed = 0;
+    CHECK(replayJournal(corrupt, [&](std::uint8_t, std::uint64_t, ByteReader&) { ++replayed; }) == ends[0]);
+    CHECK(replayed == 1);
+
+    // So does a torn last entry, keeping the two before it
+    replayed = 0;
+    CHECK(replayJournal(contents.substr(0, contents.size() - 3),
+                        [&](std::uint8_t, std::uint64_t, ByteReader&) { ++replayed; }) == ends[1]);
+    CHECK(replayed == 2);
+}
+
+// Rate integral over [from, to) one minute at a time from Tariff::rateAt
+double minuteByMinute(const Tariff& tariff, std::time_t from, std::time_t to) {
+    double total = 0.0;
+    for (std::time_t t = from; t < to; t += 60) {
+        std::tm local;
+        localtime_r(&t, &local);
+        total += tariff.rateAt(local.tm_wday, local.tm_hour * 60 + local.tm_min) * 60.0;
+    }
+    return total;
+}
+
+bool near(double a, double b) {
+    return std::fabs(a - b) <= 1e-9 * std::max(1.0, std::fabs(b));
+}
+
+void testTariffTableAcrossDst() {
+    // New York: clocks go forward on 10 March 2024 and back on 3 November
+    setenv("TZ", "America/New_York", 1);
+    tzset();
+    Tariff tariff;
+    std::string error;
+    std::istringstream text("rate 0.009\n"
+                            "window night 01:00 03:00 daily 0.004\n"
+                            "window peak 17:00 21:00 weekdays 0.02\n");
+    CHECK(parseTariff(text, tariff, error));
+
+    const std::time_t springForward = 1710054000;   // 2024-03-10 07:00 UTC, 03:00 EDT
+    const std::time_t fallBack = 1730613600;        // 2024-11-03 06:00 UTC, 01:00 EST
+    struct Span {
+        std::time_t from;
+        std::time_t to;
+    };
+    const Span spans[] = {
+        { springForward - 3 * 86400, springForward + 2 * 86400 },
+        { springForward - 4 * 3600, springForward + 4 * 3600 },
+        { fallBack - 2 * 86400, fallBack + 3 * 86400 },
+        { fallBack - 3 * 3600, fallBack + 3 * 3600 },
+    };
+    for (const Span& span : spans) {
+        TariffTable table;
+        table.compile(tariff, span.from, span.to, std::vector<std::pair<std::time_t, double> >());
+        CHECK(near(table.rateSeconds(span.from, span.to), minuteByMinute(tariff, span.from, span.to)));
+
+        // Pieces of the span, through a cursor and directly
+        TariffTable::Cursor cursor(table);
+        double pieces = 0.0;
+        for (std::time_t t = span.from; t < span.to; t += 37 * 60) {
+            std::time_t end = std::min<std::time_t>(t + 37 * 60, span.to);
+            double piece = cursor.rateSeconds(t, end);
+            CHECK(near(piece, table.rateSeconds(t, end)));
+            CHECK(near(piece, minuteByMinute(tariff, t, end)));
+            pieces += piece;
+        }
+        CHECK(near(pieces, table.rateSeconds(span.from, span.to)));
+    }
+
+    // The night window runs 01:00-03:00 local: one hour on the day clocks go
+    // forward, three on the day they go back
+    TariffTable table;
+    table.compile(tariff, springForward - 86400, fallBack + 86400, std::vector<std::pair<std::time_t, double> >());
+    double baseHour = 0.009 * 3600.0, nightHour = 0.004 * 3600.0;
+    CHECK(near(table.rateSeconds(springForward - 2 * 3600, springForward), baseHour + nightHour));
+    CHECK(near(table.rateSeconds(fallBack - 3600, fallBack + 2 * 3600), 3 * nightHour));
+    unsetenv("TZ");
+    tzset();
+}
+
+void testLoadProfileWrapAround() {
+    const int week = LoadProfile::WEEK_MINUTES;
+    LoadProfile profile;
+    profile.add(week - 10, 15, 1000);   // the last 10 minutes of the week and the first 5
+    profile.add(100, 1, 400);
+
+    CHECK(profile.peak(week - 1, 2) == 1000);
+    CHECK(profile.lastAbove(week - 20, 30, 500) == 24);   // minute 4 of the next week
+    CHECK(profile.lastAbove(week - 20, 12, 500) == 11);   // stops before the wrap
+    CHECK(profile.lastAbove(week - 20, 10, 500) == -1);
+    CHECK(profile.lastAbove(week - 20, 30, 1000) == -1);
+    CHECK(profile.lastAbove(week - 3, 120, 300) == 103);  // minute 100 after the wrap
+    CHECK(profile.lastAbove(5, week, 500) == week - 1);   // the whole week back round to minute 4
+
+    // Against a minute-by-minute search
+    std::mt19937_64 random(7);
+    for (int i = 0; i < 50; ++i) {
+        profile.add(static_cast<int>(random() % week), 1 + static_cast<int>(random() % 600),
+                    static_cast<std::int64_t>(random() % 2000));
+    }
+    for (int i = 0; i < 200; ++i) {
+        int start = static_cast<int>(random() % week);
+        int length = 1 + static_cast<int>(random() % 3000);
+        std::int64_t threshold = static_cast<std::int64_t>(random() % 20000);
+        int expected = -1;
+        for (int offset = 0; offset < length; ++offset) {
+            if (profile.peak((start + offset) % week, 1) > threshold) {
+                expected = offset;
+            }
+        }
+        CHECK(profile.lastAbove(start, length, threshold) == expected);
+    }
+}
+
+void testKernelsAgree() {
+    EnergyKernel best = forceEnergyKernel(KERNEL_AVX2);
+    if (best != KERNEL_AVX2) {
+        std::cout << "AVX2 not supported; kernel comparison skipped\n";
+        return;
+    }
+    std::mt19937_64 random(3);
+    const size_t n = 1037;   // not a multiple of the vector width
+    const std::time_t now = 1700100000;
+    std::vector<double> closed(n), ratings(n);
+    std::vector<std::time_t> open(n);
+    for (size_t i = 0; i < n; ++i) {
+        closed[i] = double(random() % 10000000);
+        ratings[i] = 1.0 + double(random() % 300000) / 100.0;
+        open[i] = random() % 3 == 0 ? 0 : now - static_cast<std::time_t>(random() % 1000000);
+    }
+    std::vector<ActivationRecord> records = sampleRecords(n, 5);
+    for (size_t i = 0; i < n; i += 10) {
+        records[i].offTime = 0;   // open
+    }
+    std::vector<std::int64_t> onTimes(n), offTimes(n);
+    std::vector<std::uint32_t> deviceIds(n);
+    for (size_t i = 0; i < n; ++i) {
+        onTimes[i] = records[i].onTime;
+        offTimes[i] = records[i].offTime == 0 ? records[i].onTime + 60 : records[i].offTime;
+        deviceIds[i] = static_cast<std::uint32_t>(random() % 64);
+    }
+    std::time_t from = records[n / 4].onTime, to = records[3 * n / 4].offTime;
+
+    std::vector<double> activeSeconds[2], energy[2], seconds[2];
+    std::int64_t clipped[2];
+    const EnergyKernel kernels[2] = { KERNEL_SCALAR, KERNEL_AVX2 };
+    for (int k = 0; k < 2; ++k) {
+        CHECK(forceEnergyKernel(kernels[k]) == kernels[k]);
+        activeSeconds[k].assign(n, 0.0);
+        energy[k].assign(n, 0.0);
+        seconds[k].assign(64, 0.0);
+        deviceTotals(closed.data(), open.data(), ratings.data(), n, now, activeSeconds[k].data(), energy[k].data());
+        clipped[k] = clippedSeconds(records.data(), n, from, to, now);
+        accumulateClippedSeconds(onTimes.data(), offTimes.data(), deviceIds.data(), n, from, to, seconds[k].data());
+    }
+    CHECK(std::memcmp(activeSeconds[0].data(), activeSeconds[1].data(), n * sizeof(double)) == 0);
+    CHECK(std::memcmp(energy[0].data(), energy[1].data(), n * sizeof(double)) == 0);
+    CHECK(std::memcmp(seconds[0].data(), seconds[1].data(), 64 * sizeof(double)) == 0);
+    CHECK(clipped[0] == clipped[1] && clipped[0] > 0);
+    forceEnergyKernel(best);
+}
+
+std::string simulatedReport(std::uint64_t seed) {
+    Home home;
+    VirtualClock clock(1700000000);
+    useVirtualClock(home, clock);
+    SimulationPlan plan = { 3, 20, 6.0, 4.0, seed };
+    SimulationResult result;
+    std::string error, report;
+    CHECK(simulateHousehold(home, plan, result, error));
+    CHECK(result.devices == 60 && result.switches > 0);
+    std::lock_guard<std::mutex> lock(home.mutex);
+    writeReport(home, home.now(), FORMAT_TEXT, report);
+    writeTrends(home, home.now(), 5, FORMAT_TEXT, report);
+    return report;
+}
+
+void testSimulationIsRepeatable() {
+    std::string first = simulatedReport(11);
+    CHECK(!first.empty());
+    CHECK(simulatedReport(11) == first);
+    CHECK(simulatedReport(12) != first);
+}
+
+} // namespace
+
+int main() {
+    testRecordBlocksRoundTrip();
+    testJournalReplay();
+    testTariffTableAcrossDst();
+    testLoadProfileWrapAround();
+    testKernelsAgree();
+    testSimulationIsRepeatable();
+    if (failures > 0) {
+        std::cerr << failures << " check(s) failed\n";
+        return 1;
+    }
+    std::cout << "All checks passed\n";
+    return 0;
+}